@@ -0,0 +1,41 @@
+# Benchmark of the integration's hot paths with synthetic configs, see main.cpp for the modes.
+# Links the plain Qt classes of the plugin, so neither the integrations.library nor the host app is needed:
+#   qmake && make && ./mqtt-benchmark --sizes 10,100,1000 --output results.json
+TEMPLATE  = app
+CONFIG   += c++14 console
+CONFIG   -= app_bundle
+QT       += core mqtt concurrent
+QT       -= gui
+TARGET    = mqtt-benchmark
+
+SRC_DIR = $$PWD/../src
+INCLUDEPATH += $$SRC_DIR
+
+HEADERS  += $$SRC_DIR/jsonreader.h \
+    $$SRC_DIR/topicrouter.h \
+    $$SRC_DIR/publishscheduler.h \
+    $$SRC_DIR/metrics.h \
+    $$SRC_DIR/buttonfeatures.h \
+    $$SRC_DIR/buttonarena.h \
+    $$SRC_DIR/activitymacro.h \
+    $$SRC_DIR/entitycompiler.h \
+    configgenerator.h \
+    fakebroker.h \
+    offlinebenchmark.h \
+    brokerbenchmark.h
+SOURCES  += $$SRC_DIR/jsonreader.cpp \
+    $$SRC_DIR/topicrouter.cpp \
+    $$SRC_DIR/publishscheduler.cpp \
+    $$SRC_DIR/metrics.cpp \
+    $$SRC_DIR/buttonfeatures.cpp \
+    $$SRC_DIR/buttonarena.cpp \
+    $$SRC_DIR/activitymacro.cpp \
+    $$SRC_DIR/entitycompiler.cpp \
+    configgenerator.cpp \
+    fakebroker.cpp \
+    offlinebenchmark.cpp \
+    brokerbenchmark.cpp \
+    main.cpp
+
+OBJECTS_DIR = $$OUT_PWD/obj
+MOC_DIR = $$OUT_PWD/moc
@@ -0,0 +1,157 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "brokerbenchmark.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+
+#include "configgenerator.h"
+
+BrokerBenchmark::BrokerBenchmark(const QString &hostname, int port, const QString &prefix, const QList<int> &sizes,
+                                 QObject *parent)
+    : QObject(parent),
+      m_client(new QMqttClient(this)),
+      m_prefix(prefix),
+      m_sizes(sizes),
+      m_sizeIndex(0),
+      m_phase(Ingest),
+      m_pollTimer(new QTimer(this)),
+      m_skipReplies(0),
+      m_requests(0),
+      // a new revision on every run, otherwise the plugin skips configs it has seen before
+      m_revision(static_cast<int>(QDateTime::currentSecsSinceEpoch() % 1000000)) {
+    m_client->setHostname(hostname);
+    m_client->setPort(static_cast<quint16>(port));
+    m_pollTimer->setInterval(POLL_INTERVAL);
+
+    QObject::connect(m_pollTimer, &QTimer::timeout, this, [this]() {
+        if (m_phaseClock.elapsed() > PHASE_TIMEOUT) {
+            m_pollTimer->stop();
+            emit failed(QString("no complete statistics from the plugin after %1 ms in phase %2 of size %3")
+                            .arg(PHASE_TIMEOUT)
+                            .arg(m_phase == Ingest ? "ingest" : "messages")
+                            .arg(m_sizes.at(m_sizeIndex)));
+            return;
+        }
+        requestStats();
+    });
+    QObject::connect(m_client, &QMqttClient::connected, this, [this]() {
+        QMqttSubscription *subscription = m_client->subscribe(QMqttTopicFilter(m_prefix + "/stats/+"), 0);
+        if (subscription == nullptr) {
+            emit failed("cannot subscribe to the statistics");
+            return;
+        }
+        QObject::connect(subscription, &QMqttSubscription::stateChanged, this,
+                         [this](QMqttSubscription::SubscriptionState state) {
+                             if (state == QMqttSubscription::Subscribed && m_sizeIndex == 0 && m_results.isEmpty()) {
+                                 startPhase(Ingest);
+                             }
+                         });
+    });
+    QObject::connect(m_client, &QMqttClient::errorChanged, this, [this](QMqttClient::ClientError error) {
+        if (error != QMqttClient::NoError) {
+            emit failed(QString("MQTT error %1").arg(error));
+        }
+    });
+    QObject::connect(m_client, &QMqttClient::messageReceived, this, &BrokerBenchmark::statsReceived);
+}
+
+void BrokerBenchmark::start() {
+    if (m_sizes.isEmpty()) {
+        emit finished(m_results);
+        return;
+    }
+    m_client->connectToHost();
+}
+
+void BrokerBenchmark::startPhase(Phase phase) {
+    int count = m_sizes.at(m_sizeIndex);
+    m_phase = phase;
+    m_phaseClock.start();
+    // the plugin answers the reset with the statistics before the reset
+    requestStats("reset");
+    m_skipReplies = 1;
+    m_requests = 0;
+
+    if (phase == Ingest) {
+        m_result.clear();
+        m_result.insert("devices", count);
+        m_result.insert("activities", count);
+        QByteArray devices = ConfigGenerator::devices(m_prefix, count, m_revision);
+        QByteArray activities = ConfigGenerator::activities(m_prefix, count, m_revision);
+        m_result.insert("config_bytes", devices.size() + activities.size());
+        m_client->publish(QMqttTopicName(m_prefix + "/config/devices"), devices);
+        m_client->publish(QMqttTopicName(m_prefix + "/config/activities"), activities);
+    } else {
+        for (int i = 0; i < STATE_MESSAGES; i++) {
+            QString topic = ConfigGenerator::stateTopic(m_prefix, i % count, i % 2 == 0 ? "power" : "volume");
+            m_client->publish(QMqttTopicName(topic), i % 2 == 0 ? QByteArray("on") : QByteArray::number(i % 100));
+        }
+        for (int i = 0; i < ACTIVITY_SWITCHES; i++) {
+            m_client->publish(QMqttTopicName(m_prefix + "/config/current_activity"),
+                              ConfigGenerator::activityName(i % count).toUtf8());
+        }
+    }
+    m_pollTimer->start();
+}
+
+void BrokerBenchmark::requestStats(const QByteArray &payload) {
+    m_requests++;
+    m_client->publish(QMqttTopicName(m_prefix + "/stats/request"), payload);
+}
+
+void BrokerBenchmark::statsReceived(const QByteArray &message, const QMqttTopicName &topic) {
+    if (topic.name().endsWith("/request") || !m_pollTimer->isActive()) {
+        return;
+    }
+    if (m_skipReplies > 0) {
+        m_skipReplies--;
+        return;
+    }
+    QVariantMap stats = QJsonDocument::fromJson(message).toVariant().toMap();
+    bool        complete;
+    if (m_phase == Ingest) {
+        complete = stats.value("config").toMap().value("count").toInt() >= 2;
+    } else {
+        // every message counts, including the stats requests after the reset
+        complete = stats.value("messages").toInt() >= STATE_MESSAGES + ACTIVITY_SWITCHES + m_requests - 1;
+    }
+    if (!complete) {
+        return;
+    }
+    m_pollTimer->stop();
+    m_result.insert(m_phase == Ingest ? "ingest" : "messages", stats);
+    m_result.insert(m_phase == Ingest ? "ingest_wall_ms" : "messages_wall_ms", m_phaseClock.elapsed());
+    if (m_phase == Ingest) {
+        startPhase(Messages);
+        return;
+    }
+    m_results.append(m_result);
+    if (++m_sizeIndex < m_sizes.size()) {
+        startPhase(Ingest);
+        return;
+    }
+    m_client->disconnectFromHost();
+    emit finished(m_results);
+}
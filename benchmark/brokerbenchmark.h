@@ -0,0 +1,84 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QtMqtt/qmqttclient.h>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVariantList>
+#include <QVariantMap>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// BROKER BENCHMARK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Drives a running plugin through a broker, e.g. a local mosquitto the remote or a desktop build is connected to.
+// For every size the synthetic configs are published on the config reply topics, then state and current activity
+// messages are replayed. After each phase the plugin's own statistics are requested on <prefix>/stats/request, so
+// the results are the latencies, counters and peak memory measured inside the plugin.
+// The plugin replaces the entities of the bridge with the synthetic ones: use a bridge prefix of its own, and
+// lazy_entities off, otherwise the state topics of the synthetic devices are not subscribed.
+class BrokerBenchmark : public QObject {
+    Q_OBJECT
+
+ public:
+    static const int STATE_MESSAGES = 5000;
+    static const int ACTIVITY_SWITCHES = 200;
+    static const int POLL_INTERVAL = 500;    // ms between two stats requests
+    static const int PHASE_TIMEOUT = 60000;  // ms
+
+    BrokerBenchmark(const QString& hostname, int port, const QString& prefix, const QList<int>& sizes,
+                    QObject* parent = nullptr);
+
+    void start();
+
+ signals:
+    void finished(const QVariantList& results);
+    void failed(const QString& error);
+
+ private:
+    enum Phase { Ingest, Messages };
+
+    QMqttClient*  m_client;
+    QString       m_prefix;
+    QList<int>    m_sizes;
+    int           m_sizeIndex;
+    Phase         m_phase;
+    QTimer*       m_pollTimer;
+    QElapsedTimer m_phaseClock;
+    int           m_skipReplies;  // replies to requests sent before the reset of the phase
+    int           m_requests;     // stats requests since the reset, they are counted as messages too
+    int           m_revision;
+    QVariantMap   m_result;
+    QVariantList  m_results;
+
+    void startPhase(Phase phase);
+    void requestStats(const QByteArray& payload = QByteArray());
+    void statsReceived(const QByteArray& message, const QMqttTopicName& topic);
+};
@@ -0,0 +1,101 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "configgenerator.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "buttonfeatures.h"
+
+QByteArray ConfigGenerator::devices(const QString &prefix, int count, int revision) {
+    QJsonObject devices;
+    for (int i = 0; i < count; i++) {
+        QString     commandTopic = QString("%1/bench/device%2/command").arg(prefix).arg(i);
+        QJsonObject buttons;
+        buttons.insert("POWERON", QJsonArray({commandTopic, "POWERON"}));
+        buttons.insert("POWEROFF", QJsonArray({commandTopic, "POWEROFF"}));
+        for (int feature = 0; buttons.size() < BUTTONS_PER_DEVICE && feature < ButtonFeatures::count(); feature++) {
+            QString name = ButtonFeatures::buttonName(feature);
+            if (!buttons.contains(name)) {
+                buttons.insert(name, QJsonArray({commandTopic, name}));
+            }
+        }
+        buttons.insert("VOLUME_SET", QJsonArray({QString("%1/bench/device%2/volume").arg(prefix).arg(i),
+                                                 "{\"vol\": ${value}}",
+                                                 QJsonObject({{"rate", 10}, {"template", true}})}));
+
+        QJsonObject state;
+        state.insert("power", stateTopic(prefix, i, "power"));
+        state.insert("volume", stateTopic(prefix, i, "volume"));
+
+        QJsonObject device;
+        device.insert("Buttons", buttons);
+        device.insert("State", state);
+        device.insert("Revision", revision);
+        devices.insert(deviceName(i), device);
+    }
+    return QJsonDocument(QJsonObject({{"devices", devices}})).toJson(QJsonDocument::Compact);
+}
+
+QByteArray ConfigGenerator::activities(const QString &prefix, int count, int revision) {
+    QJsonObject activities;
+    for (int i = 0; i < count; i++) {
+        // every device waits for the one before, the steps are run one after another
+        QJsonArray activation, deactivation;
+        for (int j = 0; j < DEVICES_PER_ACTIVITY && j < count; j++) {
+            QString     device = deviceName((i + j) % count);
+            QJsonObject on({{"device", device}, {"button", "POWERON"}, {"delay", 0}});
+            QJsonObject off({{"device", device}, {"button", "POWEROFF"}});
+            if (j > 0) {
+                on.insert("after", deviceName((i + j - 1) % count));
+                off.insert("after", QJsonArray({deviceName((i + j - 1) % count)}));
+            }
+            activation.append(on);
+            deactivation.append(off);
+        }
+        QString     first = deviceName(i);
+        QString     commandTopic = QString("%1/bench/device%2/command").arg(prefix).arg(i);
+        QJsonObject buttons;
+        buttons.insert("VOLUME_UP", QJsonArray({first, commandTopic, "VOLUME_UP"}));
+        buttons.insert("VOLUME_DOWN", QJsonArray({first, commandTopic, "VOLUME_DOWN"}));
+        buttons.insert("MUTE_TOGGLE", QJsonArray({first, commandTopic, "MUTE_TOGGLE"}));
+
+        QJsonObject activity;
+        activity.insert("activation", activation);
+        activity.insert("deactivation", deactivation);
+        activity.insert("buttons", buttons);
+        activity.insert("Revision", revision);
+        activities.insert(activityName(i), activity);
+    }
+    return QJsonDocument(QJsonObject({{"activities", activities}})).toJson(QJsonDocument::Compact);
+}
+
+QString ConfigGenerator::deviceName(int index) { return QString("Device %1").arg(index); }
+
+QString ConfigGenerator::activityName(int index) { return QString("Activity %1").arg(index); }
+
+QString ConfigGenerator::stateTopic(const QString &prefix, int device, const QString &attribute) {
+    return QString("%1/bench/device%2/state/%3").arg(prefix).arg(device).arg(attribute);
+}
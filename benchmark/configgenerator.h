@@ -0,0 +1,49 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// CONFIG GENERATOR
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Synthetic bridge configs in the format of <prefix>/config/devices and <prefix>/config/activities.
+// Every device has the power buttons, buttons of the feature table, a payload template and state topics. Every
+// activity switches a few devices with steps run by the plugin and has buttons forwarding to its first device.
+class ConfigGenerator {
+ public:
+    static const int BUTTONS_PER_DEVICE = 24;
+    static const int DEVICES_PER_ACTIVITY = 3;
+
+    // the revision is part of every entity, a new revision makes the plugin compile all entities again
+    static QByteArray devices(const QString& prefix, int count, int revision = 0);
+    // the activities switch the devices of devices() with the same count
+    static QByteArray activities(const QString& prefix, int count, int revision = 0);
+
+    static QString deviceName(int index);
+    static QString activityName(int index);
+    static QString stateTopic(const QString& prefix, int device, const QString& attribute);
+};
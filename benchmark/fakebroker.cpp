@@ -0,0 +1,37 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "fakebroker.h"
+
+void FakeBroker::subscribe(const QString &filter, const TopicRouter::Handler &handler) {
+    m_subscriptions.addRoute(filter, handler);
+}
+
+qint32 FakeBroker::publish(const QMqttTopicName &topic, const QByteArray &payload) {
+    m_messages++;
+    m_bytes += payload.size();
+    m_subscriptions.route(payload, topic);
+    // message ids of QoS 1/2 publishes wrap around like on a real connection
+    m_lastId = m_lastId % 0xFFFF + 1;
+    return m_lastId;
+}
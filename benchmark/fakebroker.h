@@ -0,0 +1,52 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QtMqtt/qmqtttopicname.h>
+
+#include <QByteArray>
+#include <QString>
+
+#include "topicrouter.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// FAKE BROKER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// In-process stand-in for the broker: a publish is counted and delivered to the matching subscriptions right away,
+// so a benchmark measures the plugin side only, without sockets or a network.
+class FakeBroker {
+ public:
+    void   subscribe(const QString& filter, const TopicRouter::Handler& handler);
+    qint32 publish(const QMqttTopicName& topic, const QByteArray& payload);
+
+    int    messages() const { return m_messages; }
+    qint64 bytes() const { return m_bytes; }
+
+ private:
+    TopicRouter m_subscriptions;
+    qint32      m_lastId = 0;
+    int         m_messages = 0;
+    qint64      m_bytes = 0;
+};
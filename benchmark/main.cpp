@@ -0,0 +1,112 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFile>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QTextStream>
+
+#include "brokerbenchmark.h"
+#include "offlinebenchmark.h"
+
+// the plugin code logs every compiled entity, only warnings are shown unless --verbose is given
+Q_LOGGING_CATEGORY(lcBenchmark, "yio.plugin.mqtt.benchmark")
+
+// Prints the results as one JSON document:
+// {"benchmark": "mqtt", "mode": "offline" or "broker", "timestamp": ..., "results": [one object per size]}
+static int writeResults(const QString &mode, const QVariantList &results, const QString &output) {
+    QVariantMap document;
+    document.insert("benchmark", "mqtt");
+    document.insert("mode", mode);
+    document.insert("timestamp", QDateTime::currentDateTimeUtc().toString(Qt::ISODate));
+    document.insert("results", results);
+    QByteArray json = QJsonDocument::fromVariant(document).toJson(QJsonDocument::Indented);
+    if (output.isEmpty()) {
+        QTextStream(stdout) << json;
+        return 0;
+    }
+    QFile file(output);
+    if (!file.open(QIODevice::WriteOnly) || file.write(json) != json.size()) {
+        QTextStream(stderr) << "cannot write " << output << ": " << file.errorString() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("mqtt-benchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Benchmark of the YIO MQTT integration with synthetic configs.\n"
+        "Without --broker the plugin's hot paths run in this process against an in-process broker stand-in.\n"
+        "With --broker a running plugin is driven through the broker and its own statistics are collected.");
+    parser.addHelpOption();
+    QCommandLineOption brokerOption("broker", "Broker of a running plugin.", "host[:port]");
+    QCommandLineOption prefixOption("prefix", "Topic prefix of the plugin's bridge.", "prefix", "mqtt_urc");
+    QCommandLineOption sizesOption("sizes", "Numbers of devices and activities.", "list", "10,100,1000");
+    QCommandLineOption iterationsOption("iterations", "Config ingests per size (offline).", "count", "20");
+    QCommandLineOption outputOption("output", "Write the JSON results to a file instead of stdout.", "file");
+    QCommandLineOption verboseOption("verbose", "Log the info messages of the plugin code.");
+    parser.addOptions({brokerOption, prefixOption, sizesOption, iterationsOption, outputOption, verboseOption});
+    parser.process(app);
+    if (!parser.isSet(verboseOption)) {
+        QLoggingCategory::setFilterRules("yio.plugin.mqtt.benchmark.info=false\nyio.plugin.mqtt.benchmark.debug=false");
+    }
+
+    QList<int> sizes;
+    for (const QString &size : parser.value(sizesOption).split(',', QString::SkipEmptyParts)) {
+        if (size.toInt() > 0) {
+            sizes.append(size.toInt());
+        }
+    }
+    QString output = parser.value(outputOption);
+
+    if (!parser.isSet(brokerOption)) {
+        OfflineBenchmark benchmark(lcBenchmark(), parser.value(iterationsOption).toInt());
+        QVariantList     results;
+        for (int size : sizes) {
+            results.append(benchmark.run(size));
+        }
+        return writeResults("offline", results, output);
+    }
+
+    QStringList     hostnamePort = parser.value(brokerOption).split(':');
+    int             port = hostnamePort.size() == 2 ? hostnamePort[1].toInt() : 1883;
+    BrokerBenchmark benchmark(hostnamePort[0], port, parser.value(prefixOption), sizes);
+    int             exitCode = 0;
+    QObject::connect(&benchmark, &BrokerBenchmark::finished, [&](const QVariantList &results) {
+        exitCode = writeResults("broker", results, output);
+        app.exit(exitCode);
+    });
+    QObject::connect(&benchmark, &BrokerBenchmark::failed, [&](const QString &error) {
+        QTextStream(stderr) << error << endl;
+        app.exit(1);
+    });
+    benchmark.start();
+    return app.exec();
+}
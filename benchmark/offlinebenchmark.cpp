@@ -0,0 +1,281 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "offlinebenchmark.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+
+#include "buttonfeatures.h"
+#include "configgenerator.h"
+#include "fakebroker.h"
+#include "metrics.h"
+#include "publishscheduler.h"
+
+static const char* PREFIX = "mqtt_urc";
+
+OfflineBenchmark::OfflineBenchmark(const QLoggingCategory &logCategory, int iterations)
+    : m_compiler(logCategory, &OfflineBenchmark::stateAttribute), m_iterations(qMax(1, iterations)) {}
+
+QVariantMap OfflineBenchmark::run(int count) {
+    QVariantMap result;
+    result.insert("devices", count);
+    result.insert("activities", count);
+    result.insert("config_bytes",
+                  ConfigGenerator::devices(PREFIX, count).size() + ConfigGenerator::activities(PREFIX, count).size());
+
+    // every iteration is a new revision of all entities, so all of them are compiled again and replace the ones of
+    // the previous iteration like a config update in the plugin. The peak is taken over all iterations.
+    Metrics    devicesIngest, activitiesIngest;
+    Model      model;
+    QByteArray devices;
+    qint64     memoryBefore = Metrics::currentMemory();
+    bool       peakReset = resetPeakMemory();
+    for (int i = 0; i < m_iterations; i++) {
+        devices = ConfigGenerator::devices(PREFIX, count, i);
+        QByteArray activities = ConfigGenerator::activities(PREFIX, count, i);
+        qint64     start = devicesIngest.now();
+        ingest(devices, "devices", &model);
+        devicesIngest.record(Metrics::Config, start);
+        start = activitiesIngest.now();
+        ingest(activities, "activities", &model);
+        activitiesIngest.record(Metrics::Config, start);
+    }
+    result.insert("ingest_devices", devicesIngest.snapshot().value("config"));
+    result.insert("ingest_activities", activitiesIngest.snapshot().value("config"));
+    if (memoryBefore >= 0 && peakReset) {
+        result.insert("peak_memory_kb", Metrics::processPeakMemory() - memoryBefore);
+        result.insert("model_memory_kb", Metrics::currentMemory() - memoryBefore);
+    }
+
+    // the bridge publishes its retained config again on every reconnect: the same message is skipped by its hash, a
+    // message with other bytes but the same entities is only compiled as far as the entity hashes
+    QByteArray reformatted[] = {devices + ' ', devices};
+    Metrics    unchangedIngest, skippedIngest;
+    for (int i = 0; i < m_iterations; i++) {
+        const QByteArray &message = reformatted[i % 2];
+        qint64            start = unchangedIngest.now();
+        ingest(message, "devices", &model);
+        unchangedIngest.record(Metrics::Config, start);
+        start = skippedIngest.now();
+        ingest(message, "devices", &model);
+        skippedIngest.record(Metrics::Config, start);
+    }
+    result.insert("ingest_unchanged", unchangedIngest.snapshot().value("config"));
+    result.insert("ingest_skipped", skippedIngest.snapshot().value("config"));
+
+    int buttons = 0, features = 0;
+    for (const EntityButtons &entity : model.entities) {
+        buttons += entity.buttons.size();
+        features += entity.featureIndex.size();
+    }
+    result.insert("buttons", buttons);
+    result.insert("features", features);
+    result.insert("button_bytes", model.arena.size());
+    result.insert("button_topics", model.arena.topicCount());
+
+    result.insert("commands", benchmarkCommands(&model));
+    result.insert("states", benchmarkStates(model));
+    result.insert("activity_switches", benchmarkActivities(&model));
+    return result;
+}
+
+bool OfflineBenchmark::ingest(const QByteArray &message, const QString &rootKey, Model *model) const {
+    QByteArray messageHash = EntityCompiler::contentHash(message);
+    if (model->messageHashes.value(rootKey) == messageHash) {
+        return false;
+    }
+    EntityCompiler::CompileJob prototype;
+    prototype.activityTopic = QString("%1/activity").arg(PREFIX);
+
+    QVector<EntityCompiler::CompileJob> jobs;
+    if (!m_compiler.split(message, rootKey, prototype, &jobs)) {
+        return false;
+    }
+    for (EntityCompiler::CompileJob &job : jobs) {
+        auto current = model->entities.constFind(job.entityId);
+        if (current != model->entities.constEnd()) {
+            job.previousHash = current->contentHash;
+        }
+    }
+    m_compiler.compileAll(&jobs).waitForFinished();
+
+    QHash<QString, EntityButtons> entities;
+    ButtonArena                   arena;
+    EntityCompiler::merge(&jobs, model->entities, model->arena, &entities, &arena);
+    model->entities.swap(entities);
+    model->arena.swap(arena);
+    model->messageHashes.insert(rootKey, messageHash);
+    return true;
+}
+
+QVariantMap OfflineBenchmark::benchmarkCommands(Model *model) const {
+    FakeBroker       broker;
+    PublishScheduler scheduler(
+        [&broker](const QMqttTopicName &topic, const QByteArray &payload, quint8, bool) {
+            return broker.publish(topic, payload);
+        },
+        []() { return false; });
+    scheduler.setOnline(true);
+
+    QStringList devices;
+    for (auto iter = model->entities.constBegin(); iter != model->entities.constEnd(); ++iter) {
+        if (iter.key().startsWith("MQTT_DEVICE")) {
+            devices.append(iter.key());
+        }
+    }
+
+    // presses cycle through the devices and the commands of the remote, which an entity names by their feature.
+    // Every tenth press is a custom command with a value for the payload template.
+    Metrics       metrics;
+    int           unsupported = 0;
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for (int i = 0; i < COMMANDS && !devices.isEmpty(); i++) {
+        qint64                     start = metrics.now();
+        auto                       entity = model->entities.find(devices.at(i % devices.size()));
+        const ButtonArena::Button *button;
+        QVariant                   value;
+        if (i % 10 == 9) {
+            value = QVariantMap({{"custom_command", 0}, {"button", "VOLUME_SET"}, {"value", i % 100}});
+            button = EntityCompiler::findButton(model->arena, *entity, "VOLUME_SET");
+        } else {
+            int command = (i / devices.size()) % ButtonFeatures::count();
+            button = m_compiler.resolveCommand(&entity.value(), command,
+                                               [command]() { return QString(ButtonFeatures::featureName(command)); });
+        }
+        QByteArray payload;
+        if (button != nullptr && model->arena.render(*button, value, &payload)) {
+            scheduler.publish(model->arena.topic(*button), payload, button->minInterval, button->coalesce, button->ttl,
+                              button->qos, button->retain);
+        } else {
+            unsupported++;
+        }
+        metrics.record(Metrics::Command, start);
+    }
+    qint64      ns = qMax(Q_INT64_C(1), elapsed.nsecsElapsed());
+    QVariantMap result = metrics.snapshot().value("command").toMap();
+    result.insert("per_second", static_cast<qint64>(COMMANDS * 1e9 / ns));
+    result.insert("published", broker.messages());
+    result.insert("queued", scheduler.queued());
+    result.insert("unsupported", unsupported);
+    return result;
+}
+
+QVariantMap OfflineBenchmark::benchmarkStates(const Model &model) const {
+    // the state topics compiled from the config are routed to handlers keeping the latest value per entity and
+    // attribute, like the plugin's state queue
+    FakeBroker                           broker;
+    QHash<QString, QHash<int, QVariant>> pending;
+    int                                  devices = 0;
+    for (auto iter = model.entities.constBegin(); iter != model.entities.constEnd(); ++iter) {
+        const QString &entityId = iter.key();
+        devices += entityId.startsWith("MQTT_DEVICE") ? 1 : 0;
+        for (const QPair<QString, int> &state : iter->stateTopics) {
+            int attribute = state.second;
+            broker.subscribe(state.first, [&pending, entityId, attribute](const QByteArray &message,
+                                                                           const QMqttTopicName &) {
+                pending[entityId].insert(attribute, message);
+            });
+        }
+    }
+
+    Metrics       metrics;
+    QElapsedTimer elapsed;
+    elapsed.start();
+    for (int i = 0; i < STATE_MESSAGES && devices > 0; i++) {
+        QMqttTopicName topic(ConfigGenerator::stateTopic(PREFIX, i % devices, i % 2 == 0 ? "power" : "volume"));
+        QByteArray     message = i % 2 == 0 ? QByteArray("on") : QByteArray::number(i % 100);
+        qint64         start = metrics.now();
+        broker.publish(topic, message);
+        metrics.record(Metrics::Message, start);
+    }
+    qint64      ns = qMax(Q_INT64_C(1), elapsed.nsecsElapsed());
+    QVariantMap result = metrics.snapshot().value("message").toMap();
+    result.insert("per_second", static_cast<qint64>(STATE_MESSAGES * 1e9 / ns));
+    result.insert("entities", pending.size());
+    return result;
+}
+
+QVariantMap OfflineBenchmark::benchmarkActivities(Model *model) const {
+    FakeBroker       broker;
+    PublishScheduler scheduler(
+        [&broker](const QMqttTopicName &topic, const QByteArray &payload, quint8, bool) {
+            return broker.publish(topic, payload);
+        },
+        []() { return false; });
+    scheduler.setOnline(true);
+
+    // the steps have no delays, a switch is the cost of the macro and the commands of its steps
+    ActivityMacro::Executor executor = [model, &scheduler](const ActivityMacro::Step &step) {
+        auto device = model->entities.constFind(step.device);
+        if (device == model->entities.constEnd()) {
+            return ActivityMacro::Failed;
+        }
+        const ButtonArena::Button *button = EntityCompiler::findButton(model->arena, *device, step.button);
+        QByteArray                 payload;
+        if (button == nullptr || !model->arena.render(*button, QVariant(), &payload)) {
+            return ActivityMacro::Failed;
+        }
+        scheduler.publish(model->arena.topic(*button), payload, button->minInterval, button->coalesce, button->ttl,
+                          button->qos, button->retain);
+        return ActivityMacro::Done;
+    };
+
+    QVector<const EntityButtons *> activities;
+    for (auto iter = model->entities.constBegin(); iter != model->entities.constEnd(); ++iter) {
+        if (iter.key().startsWith("MQTT_ACTIVITY")) {
+            activities.append(&iter.value());
+        }
+    }
+    Metrics metrics;
+    int     failed = 0;
+    for (int i = 0; i < ACTIVITY_SWITCHES && !activities.isEmpty(); i++) {
+        const EntityButtons *activity = activities.at((i / 2) % activities.size());
+        qint64               start = metrics.now();
+        ActivityMacro        macro(i % 2 == 0 ? activity->activation : activity->deactivation, executor);
+        QObject::connect(&macro, &ActivityMacro::finished, [&metrics, &failed, start](bool complete) {
+            metrics.record(Metrics::Activity, start);
+            failed += complete ? 0 : 1;
+        });
+        macro.start();
+    }
+    QVariantMap result = metrics.snapshot().value("activity").toMap();
+    result.insert("failed", failed);
+    result.insert("published", broker.messages());
+    return result;
+}
+
+bool OfflineBenchmark::resetPeakMemory() {
+    // sets the peak of the whole process to its current resident memory (Linux 4.0+), the benchmark owns its process
+    QFile clearRefs("/proc/self/clear_refs");
+    return clearRefs.open(QIODevice::WriteOnly) && clearRefs.write("5") == 1;
+}
+
+int OfflineBenchmark::stateAttribute(const QString &name) {
+    // the attributes of the host app need the integrations library, any other id is as fast
+    if (name == "power") {
+        return STATE_POWER;
+    }
+    return name == "volume" ? 0 : STATE_UNSUPPORTED;
+}
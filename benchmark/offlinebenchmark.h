@@ -0,0 +1,81 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QString>
+#include <QVariantMap>
+
+#include "buttonarena.h"
+#include "entitycompiler.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// OFFLINE BENCHMARK
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Runs the code of the plugin on synthetic configs against the in-process broker, without a host app:
+// - config ingest: the message hash check and the EntityCompiler split, thread pool compile, per entity diff and
+//   arena compaction, as in Mqtt::configReceived and Mqtt::applyConfig
+// - commands: entity lookup, EntityCompiler::resolveCommand or the custom command button, template rendering and the
+//   PublishScheduler, as in Mqtt::sendCommand
+// - state messages: routing of the compiled state topics through the TopicRouter
+// - activity switches: an ActivityMacro running the compiled steps of an activity, as in Mqtt::runActivityMacro
+// Not covered is what needs the integrations library: the entity list and entity updates of the host app.
+// Durations are recorded with Metrics, memory is the resident memory of this process.
+class OfflineBenchmark {
+ public:
+    static const int COMMANDS = 20000;
+    static const int STATE_MESSAGES = 20000;
+    static const int ACTIVITY_SWITCHES = 1000;
+
+    // ingest is repeated to get percentiles, the other phases run on the model of the last ingest
+    OfflineBenchmark(const QLoggingCategory& logCategory, int iterations);
+
+    // results of all phases with count devices and count activities
+    QVariantMap run(int count);
+
+ private:
+    typedef EntityCompiler::EntityButtons EntityButtons;
+
+    // the model of the plugin: entity id -> buttons, all buttons in one arena
+    struct Model {
+        QHash<QString, EntityButtons> entities;
+        ButtonArena                   arena;
+        QHash<QString, QByteArray>    messageHashes;  // root key -> hash of the last ingested message
+    };
+
+    EntityCompiler m_compiler;
+    int            m_iterations;
+
+    // false if the message was skipped as unchanged
+    bool ingest(const QByteArray& message, const QString& rootKey, Model* model) const;
+
+    QVariantMap benchmarkCommands(Model* model) const;
+    QVariantMap benchmarkStates(const Model& model) const;
+    QVariantMap benchmarkActivities(Model* model) const;
+
+    static bool resetPeakMemory();
+    static int  stateAttribute(const QString& name);
+};
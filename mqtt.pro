@@ -1,6 +1,6 @@
 TEMPLATE  = lib
 CONFIG   += c++14 plugin
-QT       += mqtt core quick
+QT       += mqtt core quick concurrent network
 
 # Plugin VERSION
 GIT_HASH = "$$system(git log -1 --format="%H")"
@@ -56,8 +56,28 @@ unix {
 QMAKE_SUBSTITUTES += mqtt.json.in version.txt.in
 # output path must be included for the output file from QMAKE_SUBSTITUTES
 INCLUDEPATH += $$OUT_PWD
-HEADERS  += src/mqtt.h
-SOURCES  += src/mqtt.cpp
+HEADERS  += src/mqtt.h \
+    src/jsonreader.h \
+    src/topicrouter.h \
+    src/publishscheduler.h \
+    src/metrics.h \
+    src/buttonfeatures.h \
+    src/buttonarena.h \
+    src/activitymacro.h \
+    src/entitycompiler.h \
+    src/mdnsbrowser.h \
+    src/brokerconnector.h
+SOURCES  += src/mqtt.cpp \
+    src/jsonreader.cpp \
+    src/topicrouter.cpp \
+    src/publishscheduler.cpp \
+    src/metrics.cpp \
+    src/buttonfeatures.cpp \
+    src/buttonarena.cpp \
+    src/activitymacro.cpp \
+    src/entitycompiler.cpp \
+    src/mdnsbrowser.cpp \
+    src/brokerconnector.cpp
 TARGET    = mqtt
 
 # Configure destination path. DESTDIR is set in qmake-destination-path.pri
@@ -0,0 +1,104 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "activitymacro.h"
+
+#include <QTimer>
+#include <algorithm>
+
+ActivityMacro::ActivityMacro(const QVector<Step> &steps, const Executor &executor, QObject *parent)
+    : QObject(parent),
+      m_steps(steps),
+      m_executor(executor),
+      m_states(steps.size(), Waiting),
+      m_results(steps.size(), Done),
+      m_remaining(steps.size()),
+      m_complete(true),
+      m_cancelled(false) {
+    // a step can only wait for earlier steps, so the graph has no cycles
+    for (int i = 0; i < m_steps.size(); i++) {
+        QVector<int> &dependencies = m_steps[i].dependencies;
+        auto          invalid = [i](int dependency) { return dependency < 0 || dependency >= i; };
+        dependencies.erase(std::remove_if(dependencies.begin(), dependencies.end(), invalid), dependencies.end());
+    }
+}
+
+void ActivityMacro::start() {
+    if (m_steps.isEmpty()) {
+        emit finished(true);
+        return;
+    }
+    schedule();
+}
+
+void ActivityMacro::cancel() { m_cancelled = true; }
+
+void ActivityMacro::schedule() {
+    for (int i = 0; i < m_steps.size() && !m_cancelled; i++) {
+        if (m_states[i] != Waiting) {
+            continue;
+        }
+        bool ready = true;
+        for (int dependency : m_steps[i].dependencies) {
+            ready &= m_states[dependency] == Finished;
+        }
+        if (ready) {
+            run(i);
+        }
+    }
+}
+
+void ActivityMacro::run(int index) {
+    m_states[index] = Running;
+    m_results[index] = m_executor(m_steps[index]);
+    m_complete &= m_results[index] != Failed;
+    // a skipped or failed command doesn't need any time to settle
+    int delay = m_results[index] == Done ? m_steps[index].delay : 0;
+    if (delay > 0) {
+        QTimer::singleShot(delay, this, [this, index]() { finish(index); });
+    } else {
+        finish(index);
+    }
+}
+
+void ActivityMacro::finish(int index) {
+    if (m_cancelled) {
+        return;
+    }
+    m_states[index] = Finished;
+    m_remaining--;
+    emit stepFinished(index, m_results[index]);
+    if (m_remaining == 0) {
+        emit finished(m_complete);
+        return;
+    }
+    schedule();
+}
+
+QDataStream &operator<<(QDataStream &out, const ActivityMacro::Step &step) {
+    return out << step.device << step.button << step.delay << step.dependencies;
+}
+
+QDataStream &operator>>(QDataStream &in, ActivityMacro::Step &step) {
+    return in >> step.device >> step.button >> step.delay >> step.dependencies;
+}
@@ -0,0 +1,83 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QDataStream>
+#include <QObject>
+#include <QString>
+#include <QVector>
+#include <functional>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// ACTIVITY MACRO
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Runs the activation or deactivation steps of an activity in the plugin instead of the bridge.
+// The steps form a dependency graph: the steps of one device run in order, a step may also wait for other devices,
+// all other steps run concurrently. A step is started as soon as the steps it depends on are finished, a step with a
+// delay is finished that long after its command was sent (e.g. while a device is powering up).
+class ActivityMacro : public QObject {
+    Q_OBJECT
+
+ public:
+    struct Step {
+        QString      device;        // entity id of the device
+        QString      button;        // button of the device, empty for a delay only
+        int          delay = 0;     // ms after the command until the step is finished
+        QVector<int> dependencies;  // indices of the steps which have to be finished first
+    };
+
+    enum Status { Done, Skipped, Failed };
+
+    // sends the command of a step
+    typedef std::function<Status(const Step& step)> Executor;
+
+    ActivityMacro(const QVector<Step>& steps, const Executor& executor, QObject* parent = nullptr);
+
+    void start();
+    // steps which are not finished yet are not reported anymore
+    void cancel();
+
+ signals:
+    void stepFinished(int index, int status);
+    void finished(bool complete);
+
+ private:
+    enum State { Waiting, Running, Finished };
+
+    QVector<Step>   m_steps;
+    Executor        m_executor;
+    QVector<State>  m_states;
+    QVector<Status> m_results;
+    int             m_remaining;
+    bool            m_complete;  // no step failed
+    bool            m_cancelled;
+
+    void schedule();
+    void run(int index);
+    void finish(int index);
+};
+
+QDataStream& operator<<(QDataStream& out, const ActivityMacro::Step& step);
+QDataStream& operator>>(QDataStream& in, ActivityMacro::Step& step);
@@ -0,0 +1,190 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "brokerconnector.h"
+
+#include <QHostInfo>
+
+static const char* MQTT_SERVICE = "_mqtt._tcp";
+
+BrokerConnector::BrokerConnector(const QString &hostname, int port, QObject *parent)
+    : QObject(parent),
+      m_hostname(hostname),
+      m_port(port),
+      m_lastGood(QHostAddress(), 0),
+      m_next(0),
+      m_mdns(nullptr),
+      m_lookupId(-1),
+      m_running(false) {
+    m_raceTimer.setSingleShot(true);
+    m_raceTimer.setInterval(RACE_DELAY);
+    QObject::connect(&m_raceTimer, &QTimer::timeout, this, &BrokerConnector::tryNext);
+
+    m_timeoutTimer.setSingleShot(true);
+    m_timeoutTimer.setInterval(CONNECT_TIMEOUT);
+    QObject::connect(&m_timeoutTimer, &QTimer::timeout, this, [this]() {
+        stop();
+        emit failed();
+    });
+
+    m_mdnsTimer.setSingleShot(true);
+    m_mdnsTimer.setInterval(MDNS_WAIT);
+    QObject::connect(&m_mdnsTimer, &QTimer::timeout, this, &BrokerConnector::failIfExhausted);
+}
+
+void BrokerConnector::setLastGood(const QHostAddress &address, int port) { m_lastGood = Candidate(address, port); }
+
+void BrokerConnector::start() {
+    stop();
+    m_running = true;
+    m_timeoutTimer.start();
+
+    if (!m_lastGood.first.isNull()) {
+        addCandidate(m_lastGood.first, m_lastGood.second);
+    }
+
+    QHostAddress literal;
+    if (literal.setAddress(m_hostname)) {
+        addCandidate(literal, m_port);
+        return;
+    }
+
+    // the mDNS answers and the DNS lookup arrive in any order, every address is raced as soon as it is known
+    if (m_hostname.isEmpty() || m_hostname.endsWith(".local", Qt::CaseInsensitive)) {
+        if (!m_mdns) {
+            m_mdns = new MdnsBrowser(this);
+            QObject::connect(m_mdns, &MdnsBrowser::found, this, [this](const QHostAddress &address, int port) {
+                if (m_running) {
+                    addCandidate(address, port);
+                }
+            });
+        }
+        m_mdnsTimer.start();
+        if (m_hostname.isEmpty()) {
+            m_mdns->browse(MQTT_SERVICE);
+            return;
+        }
+        m_mdns->resolve(m_hostname, m_port);
+    }
+
+    m_lookupId = QHostInfo::lookupHost(m_hostname, this, [this](const QHostInfo &info) {
+        m_lookupId = -1;
+        if (!m_running) {
+            return;
+        }
+        // the lookup sorts IPv6 and IPv4 as the system prefers, the families are interleaved for the race
+        QList<QHostAddress> v4, v6;
+        for (const QHostAddress &address : info.addresses()) {
+            (address.protocol() == QAbstractSocket::IPv6Protocol ? v6 : v4).append(address);
+        }
+        QList<QHostAddress> &first = info.addresses().value(0).protocol() == QAbstractSocket::IPv6Protocol ? v6 : v4;
+        QList<QHostAddress> &second = &first == &v6 ? v4 : v6;
+        for (int i = 0; i < qMax(first.size(), second.size()); i++) {
+            if (i < first.size()) {
+                addCandidate(first.at(i), m_port);
+            }
+            if (i < second.size()) {
+                addCandidate(second.at(i), m_port);
+            }
+        }
+        failIfExhausted();
+    });
+}
+
+void BrokerConnector::abort() { stop(); }
+
+void BrokerConnector::addCandidate(const QHostAddress &address, int port) {
+    Candidate candidate(address, port);
+    if (m_candidates.contains(candidate)) {
+        return;
+    }
+    m_candidates.append(candidate);
+    // the first candidate is tried at once, the others when the previous attempt failed or the delay is over
+    if (!m_raceTimer.isActive()) {
+        tryNext();
+    }
+}
+
+void BrokerConnector::tryNext() {
+    if (!m_running || m_next >= m_candidates.size()) {
+        return;
+    }
+    const Candidate &candidate = m_candidates.at(m_next++);
+
+    QTcpSocket *socket = new QTcpSocket(this);
+    m_sockets.append(socket);
+    QObject::connect(socket, &QTcpSocket::connected, this, [this, socket]() { attemptFinished(socket, true); });
+    QObject::connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QAbstractSocket::error), this,
+                     [this, socket](QAbstractSocket::SocketError) { attemptFinished(socket, false); });
+    socket->connectToHost(candidate.first, static_cast<quint16>(candidate.second));
+
+    m_raceTimer.start();
+}
+
+void BrokerConnector::attemptFinished(QTcpSocket *socket, bool success) {
+    if (!m_sockets.removeOne(socket)) {
+        return;
+    }
+    if (!success) {
+        socket->deleteLater();
+        // no need to wait for the delay if this one has failed already
+        m_raceTimer.stop();
+        tryNext();
+        failIfExhausted();
+        return;
+    }
+    QObject::disconnect(socket, nullptr, this, nullptr);
+    socket->setParent(nullptr);
+    stop();
+    emit connected(socket);
+}
+
+void BrokerConnector::failIfExhausted() {
+    // without the timeout when nothing is left which could still connect: no pending attempt, no untried
+    // candidate and no lookup which could add one
+    if (!m_running || !m_sockets.isEmpty() || m_next < m_candidates.size() || m_lookupId >= 0 ||
+        m_mdnsTimer.isActive()) {
+        return;
+    }
+    stop();
+    emit failed();
+}
+
+void BrokerConnector::stop() {
+    m_running = false;
+    m_raceTimer.stop();
+    m_timeoutTimer.stop();
+    m_mdnsTimer.stop();
+    if (m_lookupId >= 0) {
+        QHostInfo::abortHostLookup(m_lookupId);
+        m_lookupId = -1;
+    }
+    for (QTcpSocket *socket : m_sockets) {
+        QObject::disconnect(socket, nullptr, this, nullptr);
+        socket->abort();
+        socket->deleteLater();
+    }
+    m_sockets.clear();
+    m_candidates.clear();
+    m_next = 0;
+}
@@ -0,0 +1,89 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QPair>
+#include <QString>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "mdnsbrowser.h"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// BROKER CONNECTOR
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Establishes the TCP connection to a broker for the MQTT client (happy eyeballs, RFC 8305).
+// Candidates are the last address which worked, the addresses of the host name and brokers found by mDNS.
+// Connection attempts are started one after another with a short delay, without waiting for the previous ones to
+// fail, the first connected socket wins. The MQTT session itself is opened once on the winner: parallel sessions
+// with the same client id would take over each other on the broker.
+class BrokerConnector : public QObject {
+    Q_OBJECT
+
+ public:
+    static const int RACE_DELAY = 250;        // ms until the next candidate is tried
+    static const int CONNECT_TIMEOUT = 8000;  // ms until the whole attempt fails
+    static const int MDNS_WAIT = 2000;        // ms mDNS answers are waited for, the queries have no end of answers
+
+    // an empty host name discovers the broker with mDNS
+    BrokerConnector(const QString& hostname, int port, QObject* parent = nullptr);
+
+    // address which was connected successfully before, it is tried first
+    void setLastGood(const QHostAddress& address, int port);
+
+    void start();
+    void abort();
+
+ signals:
+    // the socket is connected, the receiver takes ownership
+    void connected(QTcpSocket* socket);
+    // all candidates have failed or the timeout is over
+    void failed();
+
+ private:
+    typedef QPair<QHostAddress, int> Candidate;
+
+    QString            m_hostname;
+    int                m_port;
+    Candidate          m_lastGood;
+    QList<Candidate>   m_candidates;  // all candidates of the current attempt, in the order they are tried
+    int                m_next;        // index of the next candidate to be tried
+    QList<QTcpSocket*> m_sockets;     // pending connection attempts
+    QTimer             m_raceTimer;
+    QTimer             m_timeoutTimer;
+    QTimer             m_mdnsTimer;  // running while mDNS answers may still add candidates
+    MdnsBrowser*       m_mdns;
+    int                m_lookupId;
+    bool               m_running;
+
+    void addCandidate(const QHostAddress& address, int port);
+    void tryNext();
+    void attemptFinished(QTcpSocket* socket, bool success);
+    void failIfExhausted();
+    void stop();
+};
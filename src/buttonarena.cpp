@@ -0,0 +1,169 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "buttonarena.h"
+
+ButtonArena::Button ButtonArena::add(const QString &name, const QString &topic, const QByteArray &payload,
+                                     bool isTemplate) {
+    QByteArray utf8Name = name.toUtf8();
+    Button     button;
+    button.nameSize = static_cast<quint16>(qMin(utf8Name.size(), 0xFFFF));
+    button.name = append(utf8Name.constData(), button.nameSize);
+    button.payloadSize = static_cast<quint32>(payload.size());
+    button.payload = append(payload.constData(), payload.size());
+    button.topic = intern(topic);
+    button.isTemplate = isTemplate;
+    if (isTemplate) {
+        compile(payload, &button);
+    }
+    return button;
+}
+
+ButtonArena::Button ButtonArena::copy(const ButtonArena &from, const Button &button) {
+    Button copy = button;
+    copy.name = append(from.m_data.constData() + button.name, button.nameSize);
+    copy.payload = append(from.m_data.constData() + button.payload, static_cast<int>(button.payloadSize));
+    copy.topic = intern(from.topic(button).name());
+    copy.segments = static_cast<quint32>(m_segments.size());
+    for (int i = 0; i < button.segmentCount; i++) {
+        m_segments.append(from.m_segments.at(static_cast<int>(button.segments) + i));
+    }
+    return copy;
+}
+
+QString ButtonArena::name(const Button &button) const {
+    return QString::fromUtf8(m_data.constData() + button.name, button.nameSize);
+}
+
+bool ButtonArena::render(const Button &button, const QVariant &param, QByteArray *rendered) const {
+    if (button.segmentCount == 0) {
+        *rendered = payload(button);
+        return true;
+    }
+    QVariantMap values = param.type() == QVariant::Map ? param.toMap() : QVariantMap();
+    rendered->clear();
+    rendered->reserve(static_cast<int>(button.payloadSize) + 16 * button.segmentCount);
+    const char *payload = m_data.constData() + button.payload;
+    for (int i = 0; i < button.segmentCount; i++) {
+        const Segment &segment = m_segments.at(static_cast<int>(button.segments) + i);
+        if (!segment.placeholder) {
+            rendered->append(payload + segment.offset, static_cast<int>(segment.size));
+            continue;
+        }
+        QString key = QString::fromUtf8(payload + segment.offset, static_cast<int>(segment.size));
+        if (!appendValue(rendered, values.isEmpty() && key == QLatin1String("value") ? param : values.value(key))) {
+            rendered->clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void ButtonArena::swap(ButtonArena &other) {
+    m_data.swap(other.m_data);
+    m_segments.swap(other.m_segments);
+    m_topics.swap(other.m_topics);
+    m_topicIndex.swap(other.m_topicIndex);
+}
+
+void ButtonArena::clear() {
+    m_data.clear();
+    m_segments.clear();
+    m_topics.clear();
+    m_topicIndex.clear();
+}
+
+quint32 ButtonArena::intern(const QString &topic) {
+    auto index = m_topicIndex.constFind(topic);
+    if (index != m_topicIndex.constEnd()) {
+        return *index;
+    }
+    quint32 next = static_cast<quint32>(m_topics.size());
+    m_topics.append(QMqttTopicName(topic));
+    m_topicIndex.insert(topic, next);
+    return next;
+}
+
+quint32 ButtonArena::append(const char *data, int size) {
+    quint32 offset = static_cast<quint32>(m_data.size());
+    m_data.append(data, size);
+    return offset;
+}
+
+void ButtonArena::compile(const QByteArray &payload, Button *button) {
+    // most payloads are static, they don't get any segments
+    int start = payload.indexOf("${");
+    if (start < 0) {
+        return;
+    }
+    button->segments = static_cast<quint32>(m_segments.size());
+    int position = 0;
+    while (start >= 0 && button->segmentCount < 0xFFFE) {
+        int end = payload.indexOf('}', start + 2);
+        if (end < 0) {
+            break;
+        }
+        if (start > position) {
+            m_segments.append({static_cast<quint32>(position), static_cast<quint32>(start - position), false});
+        }
+        m_segments.append({static_cast<quint32>(start + 2), static_cast<quint32>(end - start - 2), true});
+        button->segmentCount += start > position ? 2 : 1;
+        position = end + 1;
+        start = payload.indexOf("${", position);
+    }
+    if (position < payload.size()) {
+        m_segments.append({static_cast<quint32>(position), static_cast<quint32>(payload.size() - position), false});
+        button->segmentCount++;
+    }
+}
+
+bool ButtonArena::appendValue(QByteArray *rendered, const QVariant &value) {
+    if (!value.isValid() || value.isNull()) {
+        return false;
+    }
+    switch (static_cast<int>(value.type())) {
+        case QMetaType::Bool:
+            rendered->append(value.toBool() ? "true" : "false");
+            break;
+        case QMetaType::Int:
+        case QMetaType::UInt:
+        case QMetaType::LongLong:
+        case QMetaType::ULongLong:
+            rendered->append(QByteArray::number(value.toLongLong()));
+            break;
+        case QMetaType::Float:
+        case QMetaType::Double: {
+            // whole numbers without a fraction, so 42.0 can be used where an integer is expected
+            double number = value.toDouble();
+            if (number == static_cast<double>(static_cast<qint64>(number))) {
+                rendered->append(QByteArray::number(static_cast<qint64>(number)));
+            } else {
+                rendered->append(QByteArray::number(number, 'g', 10));
+            }
+            break;
+        }
+        default:
+            rendered->append(value.toString().toUtf8());
+    }
+    return true;
+}
@@ -0,0 +1,100 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QtMqtt/qmqtttopicname.h>
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <QVariant>
+#include <QVector>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// BUTTON ARENA
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Storage of the compiled buttons of all entities.
+// Topics are interned, button names and payloads are stored back to back as UTF-8 in one buffer and a button is a
+// small struct of offsets into it, so thousands of buttons need a handful of allocations instead of several each.
+// The arena only grows: after a config change the live buttons are copied into a fresh arena which replaces this one.
+// Template payloads may contain placeholders like ${value}, they are split into segments when the button is added so
+// a press is rendered with plain appends. Other payloads are sent as they are, even if they contain ${.
+class ButtonArena {
+ public:
+    struct Button {
+        quint32 name = 0;  // offset of the name
+        quint32 payload = 0;
+        quint32 payloadSize = 0;
+        quint32 topic = 0;        // index of the interned topic
+        quint32 segments = 0;     // index of the first template segment
+        qint32  minInterval = 0;  // ms between two publishes, 0: not rate limited
+        qint32  ttl = 0;          // ms a press stays valid while waiting for the connection, 0: no limit
+        quint16 nameSize = 0;
+        quint16 segmentCount = 0;  // 0: static payload
+        bool    coalesce = true;  // queued presses are replaced by the latest one
+        quint8  qos = 0;          // 1, 2: delivery is confirmed by the broker
+        bool    retain = false;
+        bool    isTemplate = false;  // placeholders in the payload are filled in from the command parameter
+    };
+
+    Button add(const QString& name, const QString& topic, const QByteArray& payload, bool isTemplate = false);
+    // copies a button of another arena, keeping its options
+    Button copy(const ButtonArena& from, const Button& button);
+
+    QString               name(const Button& button) const;
+    const QMqttTopicName& topic(const Button& button) const { return m_topics.at(button.topic); }
+    // raw view into the arena, valid until the arena is changed: copy it if it has to be kept
+    QByteArray payload(const Button& button) const {
+        return QByteArray::fromRawData(m_data.constData() + button.payload, static_cast<int>(button.payloadSize));
+    }
+
+    // payload with ${value} replaced by the command parameter and ${<key>} by the value of key if it is a map.
+    // Returns false if a placeholder has no value, a half filled payload is never produced.
+    bool render(const Button& button, const QVariant& param, QByteArray* rendered) const;
+
+    void swap(ButtonArena& other);
+    void clear();
+    int  size() const { return m_data.size(); }
+    int  topicCount() const { return m_topics.size(); }
+
+ private:
+    // a literal part of the payload or the key of a placeholder, relative to the payload
+    struct Segment {
+        quint32 offset;
+        quint32 size;
+        bool    placeholder;
+    };
+
+    QByteArray              m_data;
+    QVector<Segment>        m_segments;
+    QVector<QMqttTopicName> m_topics;
+    QHash<QString, quint32> m_topicIndex;
+
+    quint32 intern(const QString& topic);
+    quint32 append(const char* data, int size);
+    void    compile(const QByteArray& payload, Button* button);
+
+    static bool appendValue(QByteArray* rendered, const QVariant& value);
+};
@@ -0,0 +1,199 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "buttonfeatures.h"
+
+#include <QtGlobal>
+
+namespace {
+
+struct Entry {
+    const char* button;
+    const char* feature;
+};
+
+// clang-format off
+constexpr Entry ENTRIES[] = {
+    {"PLAY", "PLAY"},
+    {"PAUSE", "PAUSE"},
+    {"PLAY_PAUSE_TOGGLE", "PLAYTOGGLE"},
+    {"STOP", "STOP"},
+    {"FORWARD", "FORWARD"},
+    {"REVERSE", "BACKWARD"},
+    {"NEXT", "NEXT"},
+    {"PREVIOUS", "PREVIOUS"},
+    {"INFO", "INFO"},
+    {"MY_RECORDINGS", "RECORDINGS"},
+    {"RECORD", "RECORD"},
+    {"LIVE", "LIVE"},
+    {"DIGIT_0", "DIGIT_0"},
+    {"DIGIT_1", "DIGIT_1"},
+    {"DIGIT_2", "DIGIT_2"},
+    {"DIGIT_3", "DIGIT_3"},
+    {"DIGIT_4", "DIGIT_4"},
+    {"DIGIT_5", "DIGIT_5"},
+    {"DIGIT_6", "DIGIT_6"},
+    {"DIGIT_7", "DIGIT_7"},
+    {"DIGIT_8", "DIGIT_8"},
+    {"DIGIT_9", "DIGIT_9"},
+    {"DIGIT_10", "DIGIT_10"},
+    {"DIGIT_10PLUS", "DIGIT_10plus"},
+    {"DIGIT_11", "DIGIT_11"},
+    {"DIGIT_12", "DIGIT_12"},
+    {"DIGIT_SEPARATOR", "DIGIT_SEPARATOR"},
+    {"DIGIT_ENTER", "DIGIT_ENTER"},
+    {"CURSOR_UP", "CURSOR_UP"},
+    {"CURSOR_DOWN", "CURSOR_DOWN"},
+    {"CURSOR_LEFT", "CURSOR_LEFT"},
+    {"CURSOR_RIGHT", "CURSOR_RIGHT"},
+    {"CURSOR_ENTER", "CURSOR_OK"},
+    {"BACK", "BACK"},
+    {"MENU_HOME", "HOME"},
+    {"MENU", "GUIDE"},
+    {"EXIT", "EXIT"},
+    {"APP", "APP"},
+    {"POWEROFF", "POWER_OFF"},
+    {"POWERON", "POWER_ON"},
+    {"POWERTOGGLE", "POWER_TOGGLE"},
+    {"CHANNEL_UP", "CHANNEL_UP"},
+    {"CHANNEL_DOWN", "CHANNEL_DOWN"},
+    {"CHANNEL_SEARCH", "CHANNEL_SEARCH"},
+    {"FAVORITE", "FAVORITE"},
+    {"GUIDE", "MENU"},
+    {"FUNCTION_RED", "FUNCTION_RED"},
+    {"FUNCTION_GREEN", "FUNCTION_GREEN"},
+    {"FUNCTION_YELLOW", "FUNCTION_YELLOW"},
+    {"FUNCTION_BLUE", "FUNCTION_BLUE"},
+    {"FUNCTION_ORANGE", "FUNCTION_ORANGE"},
+    {"FORMAT_16_9", "FORMAT_16_9"},
+    {"FORMAT_4_3", "FORMAT_4_3"},
+    {"FORMAT_AUTO", "FORMAT_AUTO"},
+    {"VOLUME_UP", "VOLUME_UP"},
+    {"VOLUME_DOWN", "VOLUME_DOWN"},
+    {"MUTE_TOGGLE", "MUTE_TOGGLE"},
+    {"SOURCE", "SOURCE"},
+    {"INPUT_TUNER_1", "INPUT_TUNER_1"},
+    {"INPUT_TUNER_2", "INPUT_TUNER_2"},
+    {"INPUT_TUNER_Y", "INPUT_TUNER_X"},
+    {"INPUT_HDMI_1", "INPUT_HDMI_1"},
+    {"INPUT_HDMI_2", "INPUT_HDMI_2"},
+    {"INPUT_HDMI_X", "INPUT_HDMI_X"},
+    {"INPUT_X_1", "INPUT_X_1"},
+    {"INPUT_X_2", "INPUT_X_2"},
+    {"OUTPUT_HDMI_1", "OUTPUT_HDMI_1"},
+    {"OUTPUT_HDMI_2", "OUTPUT_HDMI_2"},
+    {"OUTPUT_DVI_1", "OUTPUT_DVI_1"},
+    {"OUTPUT_AUDIO_X", "OUTPUT_AUDIO_X"},
+    {"OUTPUT_X", "OUTPUT_X"},
+    {"NETFLIX", "SERVICE_NETFLIX"},
+    {"HULU", "SERVICE_HULU"},
+};
+// clang-format on
+
+constexpr int ENTRY_COUNT = sizeof(ENTRIES) / sizeof(ENTRIES[0]);
+static_assert(ENTRY_COUNT < 255, "table slots are 8 bit");
+
+// with 1024 slots for ~75 names a collision free seed is found within a few tries
+constexpr int     SLOTS = 1024;
+constexpr quint32 MAX_SEED = 256;
+
+constexpr char fold(char c) { return c == ' ' ? '_' : (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c; }
+
+// FNV-1a over the folded characters
+constexpr quint32 hashStart(quint32 seed) { return 2166136261u ^ (seed * 0x9E3779B9u); }
+constexpr quint32 hashStep(quint32 hash, char c) { return (hash ^ static_cast<quint8>(fold(c))) * 16777619u; }
+constexpr quint32 hashSlot(quint32 hash) { return (hash ^ (hash >> 15)) & (SLOTS - 1); }
+
+constexpr quint32 hash(const char* name, quint32 seed) {
+    quint32 value = hashStart(seed);
+    for (; *name != '\0'; ++name) {
+        value = hashStep(value, *name);
+    }
+    return hashSlot(value);
+}
+
+struct Table {
+    quint8  slots[SLOTS];  // entry index + 1, 0: empty
+    quint32 seed;
+    bool    valid;
+};
+
+constexpr Table buildTable(bool byFeature) {
+    for (quint32 seed = 0; seed < MAX_SEED; seed++) {
+        Table table{};
+        bool  collision = false;
+        for (int i = 0; i < ENTRY_COUNT && !collision; i++) {
+            quint32 slot = hash(byFeature ? ENTRIES[i].feature : ENTRIES[i].button, seed);
+            collision = table.slots[slot] != 0;
+            table.slots[slot] = static_cast<quint8>(i + 1);
+        }
+        if (!collision) {
+            table.seed = seed;
+            table.valid = true;
+            return table;
+        }
+    }
+    return Table{};
+}
+
+constexpr Table BUTTON_TABLE = buildTable(false);
+constexpr Table FEATURE_TABLE = buildTable(true);
+static_assert(BUTTON_TABLE.valid && FEATURE_TABLE.valid, "no perfect hash seed found, increase SLOTS or MAX_SEED");
+
+int lookup(const Table& table, bool byFeature, QStringView name) {
+    quint32 value = hashStart(table.seed);
+    for (QChar c : name) {
+        if (c.unicode() > 0x7F) {
+            return ButtonFeatures::NONE;
+        }
+        value = hashStep(value, static_cast<char>(c.unicode()));
+    }
+    int entry = table.slots[hashSlot(value)] - 1;
+    if (entry < 0) {
+        return ButtonFeatures::NONE;
+    }
+    const char* key = byFeature ? ENTRIES[entry].feature : ENTRIES[entry].button;
+    for (QChar c : name) {
+        if (*key == '\0' || fold(*key) != fold(static_cast<char>(c.unicode()))) {
+            return ButtonFeatures::NONE;
+        }
+        ++key;
+    }
+    return *key == '\0' ? entry : ButtonFeatures::NONE;
+}
+
+}  // namespace
+
+int ButtonFeatures::fromButtonName(QStringView buttonName) { return lookup(BUTTON_TABLE, false, buttonName); }
+
+int ButtonFeatures::fromFeatureName(QStringView featureName) { return lookup(FEATURE_TABLE, true, featureName); }
+
+QLatin1String ButtonFeatures::featureName(int feature) {
+    return feature >= 0 && feature < ENTRY_COUNT ? QLatin1String(ENTRIES[feature].feature) : QLatin1String();
+}
+
+QLatin1String ButtonFeatures::buttonName(int feature) {
+    return feature >= 0 && feature < ENTRY_COUNT ? QLatin1String(ENTRIES[feature].button) : QLatin1String();
+}
+
+int ButtonFeatures::count() { return ENTRY_COUNT; }
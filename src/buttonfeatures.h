@@ -0,0 +1,47 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QLatin1String>
+#include <QStringView>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// BUTTON FEATURES
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Mapping between the button names of the bridge config and the supported features of the remote entity.
+// Both directions are perfect hash tables computed at compile time, so a lookup hashes the name once and compares it
+// with a single candidate. Lookups are case-insensitive, a space in a button name equals '_', nothing is allocated.
+class ButtonFeatures {
+ public:
+    static const int NONE = -1;
+
+    static int fromButtonName(QStringView buttonName);
+    static int fromFeatureName(QStringView featureName);
+
+    // names of a feature id returned by the lookups
+    static QLatin1String featureName(int feature);
+    static QLatin1String buttonName(int feature);
+    static int           count();
+};
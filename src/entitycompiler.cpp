@@ -0,0 +1,467 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#include "entitycompiler.h"
+
+#include <QCryptographicHash>
+#include <QtConcurrent>
+
+#include "buttonfeatures.h"
+#include "jsonreader.h"
+
+EntityCompiler::EntityCompiler(const QLoggingCategory &logCategory, StateAttribute stateAttribute)
+    : m_logCategory(logCategory), m_stateAttribute(stateAttribute) {}
+
+void EntityCompiler::readButtonAliases(const QVariantMap &aliases) {
+    for (QVariantMap::const_iterator iter = aliases.begin(); iter != aliases.end(); ++iter) {
+        // the alias may name a known button or a feature
+        QString target = iter.value().toString();
+        int     feature = ButtonFeatures::fromButtonName(target);
+        if (feature == ButtonFeatures::NONE) {
+            feature = ButtonFeatures::fromFeatureName(target);
+        }
+        if (feature == ButtonFeatures::NONE) {
+            qCWarning(m_logCategory) << "unknown feature" << target << "for button alias" << iter.key();
+            continue;
+        }
+        m_buttonAliases.insert(iter.key().toUpper().replace(' ', '_'), feature);
+    }
+}
+
+int EntityCompiler::buttonFeature(const QString &buttonName) const {
+    int feature = ButtonFeatures::fromButtonName(buttonName);
+    if (feature == ButtonFeatures::NONE && !m_buttonAliases.isEmpty()) {
+        feature = m_buttonAliases.value(buttonName.toUpper().replace(' ', '_'), ButtonFeatures::NONE);
+    }
+    return feature;
+}
+
+QString EntityCompiler::entityId(const QString &bridgeName, const QString &kind, const QString &name) {
+    return bridgeName.isEmpty() ? QString("%1.%2").arg(kind, name) : QString("%1.%2/%3").arg(kind, bridgeName, name);
+}
+
+QByteArray EntityCompiler::contentHash(const QByteArray &config) {
+    return QCryptographicHash::hash(config, QCryptographicHash::Md5);
+}
+
+bool EntityCompiler::split(const QByteArray &message, const QString &rootKey, const CompileJob &prototype,
+                           QVector<CompileJob> *jobs) const {
+    JsonReader reader(message);
+    if (!reader.validate() || reader.peek() != JsonReader::Object) {
+        qCCritical(m_logCategory) << "JSON error:" << reader.errorString();
+        return false;
+    }
+    QString kind = rootKey == "devices" ? "MQTT_DEVICE" : "MQTT_ACTIVITY";
+    reader.enterObject();
+    QString key;
+    bool    found = false;
+    while (reader.nextKey(&key)) {
+        if (key != rootKey) {
+            reader.skipValue();
+            continue;
+        }
+        if (reader.peek() != JsonReader::Object) {
+            qCWarning(m_logCategory) << rootKey << "is not an object";
+            reader.skipValue();
+            continue;
+        }
+        found = true;
+        reader.enterObject();
+        QString name;
+        while (reader.nextKey(&name)) {
+            CompileJob job = prototype;
+            job.entityId = entityId(prototype.bridgeName, kind, name);
+            job.name = name;
+            job.config = reader.rawValue();  // a view into the message
+            jobs->append(job);
+        }
+    }
+    return found;
+}
+
+void EntityCompiler::compile(CompileJob *job) const {
+    if (job->lazy) {
+        listFeatures(job);
+        return;
+    }
+    job->entity.contentHash = contentHash(job->config);
+    if (job->entity.contentHash == job->previousHash) {
+        job->unchanged = true;
+        return;
+    }
+    job->entity.friendlyName = job->name;
+    job->defaults.ttl = COMMAND_TTL;
+    if (job->entityId.startsWith("MQTT_DEVICE")) {
+        compileDevice(job);
+    } else {
+        compileActivity(job);
+    }
+}
+
+QFuture<void> EntityCompiler::compileAll(QVector<CompileJob> *jobs) const {
+    return QtConcurrent::map(*jobs, [this](CompileJob &job) { compile(&job); });
+}
+
+void EntityCompiler::merge(QVector<CompileJob> *jobs, const QHash<QString, EntityButtons> &current,
+                           const ButtonArena &currentArena, QHash<QString, EntityButtons> *entities,
+                           ButtonArena *arena) {
+    // unchanged entities keep their resolved commands and handles, all buttons end up compacted in the fresh arena
+    for (CompileJob &job : *jobs) {
+        if (job.lazy || job.unchanged) {
+            continue;
+        }
+        for (Button &button : job.entity.buttons) {
+            button = arena->copy(job.arena, button);
+        }
+        entities->insert(job.entityId, job.entity);
+    }
+    for (auto iter = current.constBegin(); iter != current.constEnd(); ++iter) {
+        if (entities->contains(iter.key())) {
+            continue;
+        }
+        EntityButtons &entity = (*entities)[iter.key()];
+        entity = iter.value();
+        for (Button &button : entity.buttons) {
+            button = arena->copy(currentArena, button);
+        }
+    }
+}
+
+void EntityCompiler::listFeatures(CompileJob *job) const {
+    // the catalog shows the real features, so the entity has its buttons as soon as it is placed in the UI
+    bool       device = job->entityId.startsWith("MQTT_DEVICE");
+    JsonReader reader(job->config);
+    QString    key;
+    if (!device) {
+        job->entity.customFeatures << "POWER_ON" << "POWER_OFF";
+        job->entity.supportedFeatures << "POWER_ON" << "POWER_OFF";
+    }
+    if (reader.peek() != JsonReader::Object) {
+        return;
+    }
+    reader.enterObject();
+    while (reader.nextKey(&key)) {
+        if (key != (device ? "Buttons" : "buttons") || reader.peek() != JsonReader::Object) {
+            reader.skipValue();
+            continue;
+        }
+        QString buttonName;
+        reader.enterObject();
+        while (reader.nextKey(&buttonName)) {
+            reader.skipValue();
+            supportedFeature(buttonName, &job->entity.supportedFeatures);
+            job->entity.customFeatures.append(buttonName);
+        }
+    }
+}
+
+void EntityCompiler::compileDevice(CompileJob *job) const {
+    qCInfo(m_logCategory) << "device:" << job->name;
+    QByteArray buttons;
+    JsonReader reader(job->config);
+    QString    key;
+    if (reader.peek() == JsonReader::Object) {
+        reader.enterObject();
+        while (reader.nextKey(&key)) {
+            if (key == "Buttons") {
+                buttons = reader.rawValue();
+            } else if (key == "State") {
+                readStates(&reader, &job->entity);
+            } else if (key == "Options" && reader.peek() == JsonReader::Object) {
+                readButtonOptions(&reader, &job->defaults);
+            } else {
+                reader.skipValue();
+            }
+        }
+    }
+    JsonReader buttonsReader(buttons);
+    compileButtons(&buttonsReader, job);
+}
+
+void EntityCompiler::compileActivity(CompileJob *job) const {
+    qCInfo(m_logCategory) << "activity:" << job->name;
+
+    // activation and deactivation buttons, only the first element of each list is used
+    QByteArray activationPayload;
+    QByteArray deactivationPayload;
+    QByteArray buttons;
+    JsonReader reader(job->config);
+    QString    key;
+    if (reader.peek() == JsonReader::Object) {
+        reader.enterObject();
+        while (reader.nextKey(&key)) {
+            if ((key == "activation" || key == "deactivation") && reader.peek() == JsonReader::Array) {
+                bool activation = key == "activation";
+                readMacro(&reader, job->bridgeName, activation ? &activationPayload : &deactivationPayload,
+                          activation ? &job->entity.activation : &job->entity.deactivation);
+            } else if (key == "buttons") {
+                buttons = reader.rawValue();
+            } else if (key == "options" && reader.peek() == JsonReader::Object) {
+                readButtonOptions(&reader, &job->defaults);
+            } else {
+                reader.skipValue();
+            }
+        }
+    }
+    qCInfo(m_logCategory) << "activation payload:" << activationPayload;
+    qCInfo(m_logCategory) << "deactivation payload:" << deactivationPayload;
+    addButton(&job->arena, &job->entity, "POWERON", job->activityTopic, activationPayload, job->defaults);
+    addButton(&job->arena, &job->entity, "POWEROFF", job->activityTopic, deactivationPayload, job->defaults);
+    job->entity.customFeatures << "POWER_ON" << "POWER_OFF";
+    job->entity.supportedFeatures << "POWER_ON" << "POWER_OFF";
+
+    // iterate through all buttons
+    JsonReader buttonsReader(buttons);
+    compileButtons(&buttonsReader, job);
+}
+
+void EntityCompiler::readMacro(JsonReader *reader, const QString &bridgeName, QByteArray *payload,
+                               QVector<ActivityMacro::Step> *steps) const {
+    // either a payload for the bridge as the first element, or steps run by the plugin like
+    // {"device": "TV", "button": "POWERON", "delay": 3000, "after": ["Receiver"]}
+    QHash<QString, int> lastStep;  // device entity id -> index of its last step
+    reader->enterArray();
+    for (int i = 0; reader->nextElement(); i++) {
+        if (reader->peek() != JsonReader::Object) {
+            if (i == 0) {
+                *payload = readPayload(reader);
+            } else {
+                reader->skipValue();
+            }
+            continue;
+        }
+        QByteArray          raw = reader->rawValue();
+        JsonReader          stepReader(raw);
+        ActivityMacro::Step step;
+        QStringList         after;
+        QString             key, value;
+        stepReader.enterObject();
+        while (stepReader.nextKey(&key)) {
+            if (key == "device" && stepReader.peek() == JsonReader::String) {
+                stepReader.readString(&value);
+                step.device = entityId(bridgeName, "MQTT_DEVICE", value);
+            } else if (key == "button" && stepReader.peek() == JsonReader::String) {
+                stepReader.readString(&step.button);
+            } else if (key == "delay" && stepReader.peek() == JsonReader::Number) {
+                double delay;
+                stepReader.readNumber(&delay);
+                step.delay = qMax(0, qRound(delay));
+            } else if (key == "after" && stepReader.peek() == JsonReader::String) {
+                stepReader.readString(&value);
+                after.append(value);
+            } else if (key == "after" && stepReader.peek() == JsonReader::Array) {
+                stepReader.enterArray();
+                while (stepReader.nextElement()) {
+                    if (stepReader.peek() == JsonReader::String) {
+                        stepReader.readString(&value);
+                        after.append(value);
+                    } else {
+                        stepReader.skipValue();
+                    }
+                }
+            } else {
+                stepReader.skipValue();
+            }
+        }
+        if (step.device.isEmpty()) {
+            // a JSON payload for the bridge
+            if (i == 0) {
+                *payload = JsonReader::compact(raw);
+            }
+            continue;
+        }
+        // the steps of a device run in order, "after" waits for the steps of other devices listed before
+        if (lastStep.contains(step.device)) {
+            step.dependencies.append(lastStep.value(step.device));
+        }
+        for (const QString &device : after) {
+            auto last = lastStep.constFind(entityId(bridgeName, "MQTT_DEVICE", device));
+            if (last != lastStep.constEnd() && !step.dependencies.contains(*last)) {
+                step.dependencies.append(*last);
+            }
+        }
+        lastStep.insert(step.device, steps->size());
+        steps->append(step);
+    }
+}
+
+void EntityCompiler::compileButtons(JsonReader *buttons, CompileJob *job) const {
+    // device buttons are [topic, payload], activity buttons [device, topic, payload]
+    int topicIndex = job->entityId.startsWith("MQTT_DEVICE") ? 0 : 1;
+
+    // iterate through all buttons
+    QString buttonName;
+    bool    hasButtons = buttons->peek() == JsonReader::Object && buttons->enterObject();
+    while (hasButtons && buttons->nextKey(&buttonName)) {
+        if (buttons->peek() != JsonReader::Array) {
+            buttons->skipValue();
+            continue;
+        }
+        // an optional options object may follow the payload
+        QString    buttonTopic;
+        QByteArray payload;
+        Button     options = job->defaults;
+        buttons->enterArray();
+        for (int i = 0; buttons->nextElement(); i++) {
+            if (i == topicIndex && buttons->peek() == JsonReader::String) {
+                buttons->readString(&buttonTopic);
+            } else if (i == topicIndex + 1) {
+                payload = readPayload(buttons);
+            } else if (i == topicIndex + 2 && buttons->peek() == JsonReader::Object) {
+                readButtonOptions(buttons, &options);
+            } else {
+                buttons->skipValue();
+            }
+        }
+        addButton(&job->arena, &job->entity, buttonName, buttonTopic, payload, options);
+
+        supportedFeature(buttonName, &job->entity.supportedFeatures);
+        job->entity.customFeatures.append(buttonName);
+    }
+}
+
+void EntityCompiler::readStates(JsonReader *reader, EntityButtons *entity) const {
+    if (reader->peek() != JsonReader::Object) {
+        reader->skipValue();
+        return;
+    }
+    reader->enterObject();
+    QString key;
+    while (reader->nextKey(&key)) {
+        if (reader->peek() != JsonReader::String) {
+            reader->skipValue();
+            continue;
+        }
+        QString value;
+        reader->readString(&value);
+        if (key == "entity_id") {
+            entity->stateEntityId = value;
+        } else if (m_stateAttribute(key) != STATE_UNSUPPORTED) {
+            entity->stateTopics.append(qMakePair(value, m_stateAttribute(key)));
+        } else {
+            qCWarning(m_logCategory) << "unsupported state:" << key;
+        }
+    }
+}
+
+bool EntityCompiler::supportedFeature(const QString &buttonName, QStringList *supportedFeatures) const {
+    int feature = buttonFeature(buttonName);
+    if (feature == ButtonFeatures::NONE) {
+        return false;
+    }
+    supportedFeatures->append(ButtonFeatures::featureName(feature));
+    return true;
+}
+
+void EntityCompiler::addButton(ButtonArena *arena, EntityButtons *entityButtons, const QString &name,
+                               const QString &topic, const QByteArray &payload, const Button &options) const {
+    Button button = arena->add(name, topic, payload, options.isTemplate);
+    button.minInterval = options.minInterval;
+    button.coalesce = options.coalesce;
+    button.ttl = options.ttl;
+    button.qos = options.qos;
+    button.retain = options.retain;
+    int feature = buttonFeature(name);
+    entityButtons->buttons.append(button);
+    // the first button wins if several buttons map to the same feature
+    if (feature != ButtonFeatures::NONE && !entityButtons->featureIndex.contains(feature)) {
+        entityButtons->featureIndex.insert(feature, entityButtons->buttons.size() - 1);
+    }
+}
+
+const EntityCompiler::Button *EntityCompiler::resolveCommand(EntityButtons *entityButtons, int command,
+                                                            const std::function<QString()> &commandName) const {
+    if (command < 0) {
+        return nullptr;
+    }
+    if (command >= entityButtons->commandSlots.size()) {
+        entityButtons->commandSlots.resize(command + 1);
+    }
+    int &slot = entityButtons->commandSlots[command];
+    if (slot == 0) {
+        QString name = commandName();
+        if (name.isNull()) {
+            return nullptr;
+        }
+        int feature = ButtonFeatures::fromFeatureName(name);
+        slot = entityButtons->featureIndex.value(feature, -2) + 1;
+        qCDebug(m_logCategory) << "resolved command" << command << name << "to button slot" << slot;
+    }
+    return slot > 0 ? &entityButtons->buttons.at(slot - 1) : nullptr;
+}
+
+const EntityCompiler::Button *EntityCompiler::findButton(const ButtonArena &arena, const EntityButtons &entityButtons,
+                                                        const QString &name) {
+    for (const Button &button : entityButtons.buttons) {
+        if (arena.name(button) == name) {
+            return &button;
+        }
+    }
+    return nullptr;
+}
+
+QByteArray EntityCompiler::readPayload(JsonReader *reader) {
+    switch (reader->peek()) {
+        case JsonReader::String: {
+            QString payload;
+            reader->readString(&payload);
+            return payload.toUtf8();
+        }
+        case JsonReader::Object:
+        case JsonReader::Array:
+            // JSON payloads are sent as they are in the config, there's no need to build and serialize a document
+            return JsonReader::compact(reader->rawValue());
+        default:
+            reader->skipValue();
+            return QByteArray();
+    }
+}
+
+void EntityCompiler::readButtonOptions(JsonReader *reader, Button *button) {
+    reader->enterObject();
+    QString key;
+    while (reader->nextKey(&key)) {
+        if (key == "rate" && reader->peek() == JsonReader::Number) {
+            // maximum number of publishes per second
+            double rate;
+            reader->readNumber(&rate);
+            button->minInterval = rate > 0 ? qRound(1000 / rate) : 0;
+        } else if (key == "coalesce" && reader->peek() == JsonReader::Bool) {
+            reader->readBool(&button->coalesce);
+        } else if (key == "ttl" && reader->peek() == JsonReader::Number) {
+            double ttl;
+            reader->readNumber(&ttl);
+            button->ttl = qRound(ttl);
+        } else if (key == "qos" && reader->peek() == JsonReader::Number) {
+            double qos;
+            reader->readNumber(&qos);
+            button->qos = static_cast<quint8>(qBound(0, qRound(qos), 2));
+        } else if (key == "retain" && reader->peek() == JsonReader::Bool) {
+            reader->readBool(&button->retain);
+        } else if (key == "template" && reader->peek() == JsonReader::Bool) {
+            // only opted in payloads are parsed for ${...}, others are published literally
+            reader->readBool(&button->isTemplate);
+        } else {
+            reader->skipValue();
+        }
+    }
+}
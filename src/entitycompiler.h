@@ -0,0 +1,144 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+#pragma once
+
+#include <QByteArray>
+#include <QFuture>
+#include <QHash>
+#include <QLoggingCategory>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+#include <QVector>
+#include <functional>
+
+#include "activitymacro.h"
+#include "buttonarena.h"
+
+class EntityInterface;
+class JsonReader;
+
+// Presses issued while disconnected are replayed after reconnecting if they are not older than this
+const int COMMAND_TTL = 5000;
+
+const int STATE_POWER = -1;  // pseudo attribute for the entity state
+const int STATE_UNSUPPORTED = -2;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// ENTITY COMPILER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Compiles the devices and activities of a bridge config into the buttons a press is sent with, and resolves the
+// commands of the remote to these buttons. Only Qt is used, so the benchmark runs the same code as the integration.
+class EntityCompiler {
+ public:
+    typedef ButtonArena::Button Button;
+    // attribute of a state name, STATE_UNSUPPORTED if the name is unknown
+    typedef int (*StateAttribute)(const QString& name);
+
+    // Buttons of one entity, compiled at config ingest so a button press is a table lookup plus one publish.
+    struct EntityButtons {
+        QVector<Button>     buttons;
+        QHash<int, int>     featureIndex;  // ButtonFeatures id -> index in buttons
+        QVector<int>        commandSlots;  // command id -> index in buttons + 1, 0: not resolved yet, -1: unsupported
+        QByteArray          contentHash;   // hash of the config subtree the buttons were built from
+        QString             friendlyName;
+        QStringList         supportedFeatures;
+        QStringList         customFeatures;
+        EntityInterface*    entity = nullptr;  // cached handle, resolved on first use
+        int                 bridge = 0;        // index in the bridges of the integration
+
+        // state feedback: topic -> attribute (STATE_POWER or an attribute of StateAttribute)
+        QString                    stateEntityId;  // entity receiving the states, this entity if empty
+        QList<QPair<QString, int>> stateTopics;
+
+        // activity steps run by the plugin, empty: the activation and deactivation payloads are sent to the bridge
+        QVector<ActivityMacro::Step> activation;
+        QVector<ActivityMacro::Step> deactivation;
+    };
+
+    // One device or activity of a config message, compiled on the thread pool into its own arena.
+    struct CompileJob {
+        QString       entityId;
+        QString       name;
+        QByteArray    config;  // raw JSON of the device or activity
+        QString       bridgeName;
+        QString       activityTopic;
+        QByteArray    previousHash;  // content hash of the entity in use, empty for a new entity
+        Button        defaults;      // options of all buttons of the entity, overridden per button
+        bool          lazy = false;  // only its features are listed in the catalog, compiled on first use
+        bool          unchanged = false;
+        EntityButtons entity;
+        ButtonArena   arena;
+    };
+
+    EntityCompiler(const QLoggingCategory& logCategory, StateAttribute stateAttribute);
+
+    // configured button name -> button name or feature
+    void                       readButtonAliases(const QVariantMap& aliases);
+    const QHash<QString, int>& buttonAliases() const { return m_buttonAliases; }
+    int                        buttonFeature(const QString& buttonName) const;
+
+    // MQTT_DEVICE.<device> for an unnamed bridge, MQTT_DEVICE.<bridge>/<device> otherwise
+    static QString    entityId(const QString& bridgeName, const QString& kind, const QString& name);
+    static QByteArray contentHash(const QByteArray& config);
+
+    // Splits a config message into one job per device or activity below rootKey, the jobs are views into the message.
+    // The bridge of the jobs is taken from the prototype. Returns false if the message has no rootKey object.
+    bool split(const QByteArray& message, const QString& rootKey, const CompileJob& prototype,
+               QVector<CompileJob>* jobs) const;
+    // only the job and the button aliases are used, jobs may be compiled concurrently
+    void          compile(CompileJob* job) const;
+    QFuture<void> compileAll(QVector<CompileJob>* jobs) const;
+    // the compiled jobs and the current entities which were not compiled again, compacted into a fresh arena
+    static void merge(QVector<CompileJob>* jobs, const QHash<QString, EntityButtons>& current,
+                      const ButtonArena& currentArena, QHash<QString, EntityButtons>* entities, ButtonArena* arena);
+
+    void addButton(ButtonArena* arena, EntityButtons* entityButtons, const QString& name, const QString& topic,
+                   const QByteArray& payload, const Button& options) const;
+
+    // Button of a command of the remote. Command ids are only known by the entity: the command name is asked for once,
+    // the result is kept for all following presses. A null command name is not kept, e.g. without an entity yet.
+    const Button* resolveCommand(EntityButtons* entityButtons, int command,
+                                 const std::function<QString()>& commandName) const;
+    static const Button* findButton(const ButtonArena& arena, const EntityButtons& entityButtons,
+                                    const QString& name);
+
+ private:
+    const QLoggingCategory& m_logCategory;
+    StateAttribute          m_stateAttribute;
+    QHash<QString, int>     m_buttonAliases;  // configured button name -> ButtonFeatures id
+
+    void listFeatures(CompileJob* job) const;
+    void compileDevice(CompileJob* job) const;
+    void compileActivity(CompileJob* job) const;
+    void compileButtons(JsonReader* buttons, CompileJob* job) const;
+    void readMacro(JsonReader* reader, const QString& bridgeName, QByteArray* payload,
+                   QVector<ActivityMacro::Step>* steps) const;
+    void readStates(JsonReader* reader, EntityButtons* entity) const;
+    bool supportedFeature(const QString& buttonName, QStringList* supportedFeatures) const;
+
+    static QByteArray readPayload(JsonReader* reader);
+    static void       readButtonOptions(JsonReader* reader, Button* button);
+};
@@ -0,0 +1,377 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "jsonreader.h"
+
+#include <cctype>
+#include <cstring>
+
+JsonReader::JsonReader(const QByteArray &data)
+    : m_data(data), m_pos(data.constData()), m_end(data.constData() + data.size()), m_error(nullptr),
+      m_errorOffset(0) {}
+
+bool JsonReader::validate() {
+    const char *begin = m_pos;
+    if (!skipValue(0)) {
+        return false;
+    }
+    skipWhitespace();
+    if (m_pos != m_end) {
+        return fail("garbage after document");
+    }
+    m_pos = begin;
+    return true;
+}
+
+JsonReader::Type JsonReader::peek() {
+    skipWhitespace();
+    if (m_error != nullptr || m_pos >= m_end) {
+        return Invalid;
+    }
+    switch (*m_pos) {
+        case '{':
+            return Object;
+        case '[':
+            return Array;
+        case '"':
+            return String;
+        case 't':
+        case 'f':
+            return Bool;
+        case 'n':
+            return Null;
+        default:
+            return (*m_pos == '-' || (*m_pos >= '0' && *m_pos <= '9')) ? Number : Invalid;
+    }
+}
+
+bool JsonReader::enterObject() {
+    skipWhitespace();
+    return expect('{');
+}
+
+bool JsonReader::nextKey(QString *key) {
+    skipWhitespace();
+    if (m_error != nullptr) {
+        return false;
+    }
+    if (m_pos < m_end && *m_pos == ',') {
+        ++m_pos;
+        skipWhitespace();
+    }
+    if (m_pos < m_end && *m_pos == '}') {
+        ++m_pos;
+        return false;
+    }
+    if (!readString(key)) {
+        return false;
+    }
+    skipWhitespace();
+    return expect(':');
+}
+
+bool JsonReader::enterArray() {
+    skipWhitespace();
+    return expect('[');
+}
+
+bool JsonReader::nextElement() {
+    skipWhitespace();
+    if (m_error != nullptr) {
+        return false;
+    }
+    if (m_pos < m_end && *m_pos == ',') {
+        ++m_pos;
+        skipWhitespace();
+    }
+    if (m_pos < m_end && *m_pos == ']') {
+        ++m_pos;
+        return false;
+    }
+    if (m_pos >= m_end) {
+        return fail("unexpected end of data");
+    }
+    return true;
+}
+
+bool JsonReader::readString(QString *value) {
+    skipWhitespace();
+    const char *begin = m_pos + 1;
+    if (!skipString()) {
+        return false;
+    }
+    const char *end = m_pos - 1;
+
+    // fast path: no escape sequences
+    const char *escape = static_cast<const char *>(memchr(begin, '\\', static_cast<size_t>(end - begin)));
+    if (escape == nullptr) {
+        *value = QString::fromUtf8(begin, static_cast<int>(end - begin));
+        return true;
+    }
+
+    value->clear();
+    const char *segment = begin;
+    for (const char *p = escape; p < end; ++p) {
+        if (*p != '\\') {
+            continue;
+        }
+        value->append(QString::fromUtf8(segment, static_cast<int>(p - segment)));
+        ++p;
+        switch (*p) {
+            case 'b':
+                value->append(QChar('\b'));
+                break;
+            case 'f':
+                value->append(QChar('\f'));
+                break;
+            case 'n':
+                value->append(QChar('\n'));
+                break;
+            case 'r':
+                value->append(QChar('\r'));
+                break;
+            case 't':
+                value->append(QChar('\t'));
+                break;
+            case 'u':
+                // surrogate pairs are two escapes in JSON and two code units in QString, so no special handling
+                value->append(QChar(static_cast<ushort>(QByteArray(p + 1, 4).toUShort(nullptr, 16))));
+                p += 4;
+                break;
+            default:
+                value->append(QChar(*p));
+                break;
+        }
+        segment = p + 1;
+    }
+    value->append(QString::fromUtf8(segment, static_cast<int>(end - segment)));
+    return true;
+}
+
+bool JsonReader::readNumber(double *value) {
+    skipWhitespace();
+    const char *begin = m_pos;
+    if (!skipNumber()) {
+        return false;
+    }
+    *value = QByteArray(begin, static_cast<int>(m_pos - begin)).toDouble();
+    return true;
+}
+
+bool JsonReader::readBool(bool *value) {
+    skipWhitespace();
+    if (m_pos < m_end && *m_pos == 't') {
+        *value = true;
+        return skipLiteral("true", 4);
+    }
+    *value = false;
+    return skipLiteral("false", 5);
+}
+
+bool JsonReader::skipValue() { return skipValue(0); }
+
+QByteArray JsonReader::rawValue() {
+    skipWhitespace();
+    const char *begin = m_pos;
+    if (!skipValue(0)) {
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(begin, static_cast<int>(m_pos - begin));
+}
+
+QString JsonReader::errorString() const {
+    return m_error == nullptr ? QString() : QString("%1 at offset %2").arg(m_error).arg(m_errorOffset);
+}
+
+QByteArray JsonReader::compact(const QByteArray &json) {
+    QByteArray result;
+    result.reserve(json.size());
+    bool inString = false;
+    for (const char *p = json.constData(), *end = p + json.size(); p < end; ++p) {
+        char c = *p;
+        if (inString) {
+            result.append(c);
+            if (c == '\\' && p + 1 < end) {
+                result.append(*++p);
+            } else if (c == '"') {
+                inString = false;
+            }
+        } else if (c != ' ' && c != '\t' && c != '\n' && c != '\r') {
+            result.append(c);
+            inString = c == '"';
+        }
+    }
+    return result;
+}
+
+void JsonReader::skipWhitespace() {
+    while (m_pos < m_end && (*m_pos == ' ' || *m_pos == '\t' || *m_pos == '\n' || *m_pos == '\r')) {
+        ++m_pos;
+    }
+}
+
+bool JsonReader::fail(const char *error) {
+    if (m_error == nullptr) {
+        m_error = error;
+        m_errorOffset = static_cast<int>(m_pos - m_data.constData());
+    }
+    // stop all further reading
+    m_pos = m_end;
+    return false;
+}
+
+bool JsonReader::expect(char c) {
+    if (m_error != nullptr) {
+        return false;
+    }
+    if (m_pos >= m_end || *m_pos != c) {
+        return fail("unexpected character");
+    }
+    ++m_pos;
+    return true;
+}
+
+bool JsonReader::skipValue(int depth) {
+    skipWhitespace();
+    if (m_error != nullptr) {
+        return false;
+    }
+    if (m_pos >= m_end) {
+        return fail("unexpected end of data");
+    }
+    if (depth > MAX_DEPTH) {
+        return fail("document too deep");
+    }
+    switch (*m_pos) {
+        case '{':
+            ++m_pos;
+            skipWhitespace();
+            if (m_pos < m_end && *m_pos == '}') {
+                ++m_pos;
+                return true;
+            }
+            while (true) {
+                skipWhitespace();
+                if (!skipString()) {
+                    return false;
+                }
+                skipWhitespace();
+                if (!expect(':') || !skipValue(depth + 1)) {
+                    return false;
+                }
+                skipWhitespace();
+                if (m_pos < m_end && *m_pos == ',') {
+                    ++m_pos;
+                } else {
+                    return expect('}');
+                }
+            }
+        case '[':
+            ++m_pos;
+            skipWhitespace();
+            if (m_pos < m_end && *m_pos == ']') {
+                ++m_pos;
+                return true;
+            }
+            while (true) {
+                if (!skipValue(depth + 1)) {
+                    return false;
+                }
+                skipWhitespace();
+                if (m_pos < m_end && *m_pos == ',') {
+                    ++m_pos;
+                } else {
+                    return expect(']');
+                }
+            }
+        case '"':
+            return skipString();
+        case 't':
+            return skipLiteral("true", 4);
+        case 'f':
+            return skipLiteral("false", 5);
+        case 'n':
+            return skipLiteral("null", 4);
+        default:
+            return skipNumber();
+    }
+}
+
+bool JsonReader::skipString() {
+    if (!expect('"')) {
+        return false;
+    }
+    while (m_pos < m_end) {
+        char c = *m_pos++;
+        if (c == '"') {
+            return true;
+        } else if (c == '\\') {
+            if (m_pos >= m_end) {
+                break;
+            }
+            if (*m_pos == 'u') {
+                if (m_end - m_pos < 5) {
+                    break;
+                }
+                for (int i = 1; i <= 4; i++) {
+                    if (!isxdigit(static_cast<unsigned char>(m_pos[i]))) {
+                        return fail("invalid unicode escape");
+                    }
+                }
+                m_pos += 5;
+            } else if (strchr("\"\\/bfnrt", *m_pos) != nullptr && *m_pos != '\0') {
+                ++m_pos;
+            } else {
+                return fail("invalid escape sequence");
+            }
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            return fail("control character in string");
+        }
+    }
+    return fail("unterminated string");
+}
+
+bool JsonReader::skipLiteral(const char *literal, int length) {
+    if (m_end - m_pos < length || memcmp(m_pos, literal, static_cast<size_t>(length)) != 0) {
+        return fail("invalid literal");
+    }
+    m_pos += length;
+    return true;
+}
+
+bool JsonReader::skipNumber() {
+    const char *begin = m_pos;
+    if (m_pos < m_end && *m_pos == '-') {
+        ++m_pos;
+    }
+    const char *digits = m_pos;
+    while (m_pos < m_end && ((*m_pos >= '0' && *m_pos <= '9') || *m_pos == '.' || *m_pos == 'e' || *m_pos == 'E' ||
+                             *m_pos == '+' || *m_pos == '-')) {
+        ++m_pos;
+    }
+    if (m_pos == digits || !(*digits >= '0' && *digits <= '9')) {
+        m_pos = begin;
+        return fail("invalid value");
+    }
+    return true;
+}
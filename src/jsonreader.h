@@ -0,0 +1,80 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// JSON READER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Forward-only JSON reader working directly on the raw message bytes. Nothing is materialized unless asked for:
+// values can be skipped, read as strings or captured as raw slices of the original data.
+// Raw slices share the memory of the data passed to the constructor and must not outlive it.
+class JsonReader {
+ public:
+    enum Type { Invalid, Object, Array, String, Number, Bool, Null };
+
+    explicit JsonReader(const QByteArray& data);
+
+    // checks the whole document once so a malformed message is rejected before anything is applied
+    bool validate();
+
+    Type peek();
+    bool enterObject();
+    bool nextKey(QString* key);  // false at the end of the object
+    bool enterArray();
+    bool nextElement();  // false at the end of the array
+    bool readString(QString* value);
+    bool readNumber(double* value);
+    bool readBool(bool* value);
+    bool skipValue();
+
+    // skips the next value and returns its raw bytes without copying them
+    QByteArray rawValue();
+
+    bool    hasError() const { return m_error != nullptr; }
+    QString errorString() const;
+
+    // copy of a JSON text without insignificant whitespace
+    static QByteArray compact(const QByteArray& json);
+
+ private:
+    static const int MAX_DEPTH = 64;
+
+    QByteArray  m_data;
+    const char* m_pos;
+    const char* m_end;
+    const char* m_error;
+    int         m_errorOffset;
+
+    void skipWhitespace();
+    bool fail(const char* error);
+    bool expect(char c);
+    bool skipValue(int depth);
+    bool skipString();
+    bool skipLiteral(const char* literal, int length);
+    bool skipNumber();
+};
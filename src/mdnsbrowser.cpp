@@ -0,0 +1,171 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "mdnsbrowser.h"
+
+#include <QtEndian>
+
+static const char* MDNS_ADDRESS = "224.0.0.251";
+
+MdnsBrowser::MdnsBrowser(QObject *parent) : QObject(parent), m_socket(new QUdpSocket(this)) {
+    m_socket->bind(QHostAddress::AnyIPv4, 0);
+    QObject::connect(m_socket, &QUdpSocket::readyRead, this, &MdnsBrowser::readDatagrams);
+}
+
+void MdnsBrowser::browse(const QString &service) {
+    // the responders don't repeat answers for a while, a new browse starts over
+    m_queried.clear();
+    query(service + ".local", PTR);
+}
+
+void MdnsBrowser::resolve(const QString &host, int port) {
+    // setPort() asks for the address
+    m_queried.clear();
+    setPort(host.toLower(), port);
+}
+
+void MdnsBrowser::query(const QString &name, Type type) {
+    m_queried.insert(name);
+    // header: id 0, standard query, one question
+    QByteArray packet(12, '\0');
+    packet[5] = 1;
+    for (const QString &label : name.split('.', QString::SkipEmptyParts)) {
+        QByteArray utf8 = label.toUtf8().left(63);
+        packet.append(static_cast<char>(utf8.size())).append(utf8);
+    }
+    packet.append('\0');
+    packet.append('\0').append(static_cast<char>(type));
+    packet.append('\0').append('\1');  // class IN
+    m_socket->writeDatagram(packet, QHostAddress(QString(MDNS_ADDRESS)), MDNS_PORT);
+}
+
+void MdnsBrowser::readDatagrams() {
+    while (m_socket->hasPendingDatagrams()) {
+        QByteArray packet(static_cast<int>(m_socket->pendingDatagramSize()), '\0');
+        m_socket->readDatagram(packet.data(), packet.size());
+        parse(packet);
+    }
+}
+
+void MdnsBrowser::parse(const QByteArray &packet) {
+    const uchar *data = reinterpret_cast<const uchar *>(packet.constData());
+    if (packet.size() < 12 || !(data[2] & 0x80)) {
+        return;  // not a response
+    }
+    int questions = qFromBigEndian<quint16>(data + 4);
+    int records = qFromBigEndian<quint16>(data + 6) + qFromBigEndian<quint16>(data + 8) +
+                  qFromBigEndian<quint16>(data + 10);
+    int offset = 12;
+    for (int i = 0; i < questions; i++) {
+        readName(packet, &offset);
+        offset += 4;
+    }
+    // answers, authority and additional records are handled alike, responders put SRV and A in the additional ones
+    for (int i = 0; i < records; i++) {
+        QString name = readName(packet, &offset);
+        if (offset + 10 > packet.size()) {
+            return;
+        }
+        int type = qFromBigEndian<quint16>(data + offset);
+        int size = qFromBigEndian<quint16>(data + offset + 8);
+        offset += 10;
+        if (offset + size > packet.size()) {
+            return;
+        }
+        int rdata = offset;
+        offset += size;
+        if (type == PTR) {
+            QString instance = readName(packet, &rdata);
+            if (!m_queried.contains(instance)) {
+                query(instance, SRV);
+            }
+        } else if (type == SRV && size > 6) {
+            int port = qFromBigEndian<quint16>(data + rdata + 4);
+            rdata += 6;
+            setPort(readName(packet, &rdata), port);
+        } else if (type == A && size == 4) {
+            addAddress(name, QHostAddress(qFromBigEndian<quint32>(data + rdata)));
+        } else if (type == AAAA && size == 16) {
+            addAddress(name, QHostAddress(data + rdata));
+        }
+    }
+}
+
+void MdnsBrowser::addAddress(const QString &host, const QHostAddress &address) {
+    QList<QHostAddress> &addresses = m_addresses[host];
+    if (!addresses.contains(address)) {
+        addresses.append(address);
+    }
+    auto port = m_ports.constFind(host);
+    if (port != m_ports.constEnd()) {
+        emit found(address, *port);
+    }
+}
+
+void MdnsBrowser::setPort(const QString &host, int port) {
+    m_ports.insert(host, port);
+    // the address may have been announced already, otherwise it is asked for
+    for (const QHostAddress &address : m_addresses.value(host)) {
+        emit found(address, port);
+    }
+    if (!m_addresses.contains(host) && !m_queried.contains(host)) {
+        query(host, A);
+    }
+}
+
+QString MdnsBrowser::readName(const QByteArray &packet, int *offset) {
+    // labels, possibly ending with a pointer to a name earlier in the packet (compression)
+    QStringList labels;
+    int         position = *offset;
+    int         jumps = 0;
+    bool        jumped = false;
+    while (position < packet.size()) {
+        quint8 length = static_cast<quint8>(packet.at(position));
+        if (length == 0) {
+            position++;
+            break;
+        }
+        if ((length & 0xC0) == 0xC0) {
+            if (position + 1 >= packet.size() || ++jumps > 16) {
+                position = packet.size();
+                break;
+            }
+            if (!jumped) {
+                *offset = position + 2;
+                jumped = true;
+            }
+            position = ((length & 0x3F) << 8) | static_cast<quint8>(packet.at(position + 1));
+            continue;
+        }
+        if (position + 1 + length > packet.size()) {
+            position = packet.size();
+            break;
+        }
+        labels.append(QString::fromUtf8(packet.constData() + position + 1, length));
+        position += 1 + length;
+    }
+    if (!jumped) {
+        *offset = position;
+    }
+    return labels.join('.').toLower();
+}
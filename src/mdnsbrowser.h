@@ -0,0 +1,73 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QHostAddress>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QUdpSocket>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// MDNS BROWSER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Minimal mDNS / DNS-SD client (RFC 6762, 6763) to find brokers without a configured or resolvable address.
+// Queries are sent from an ephemeral port, so responders answer with unicast and no multicast group has to be joined.
+// Only what is needed to get from a service type to addresses and ports is parsed: PTR, SRV, A and AAAA records.
+class MdnsBrowser : public QObject {
+    Q_OBJECT
+
+ public:
+    static const quint16 MDNS_PORT = 5353;
+
+    explicit MdnsBrowser(QObject* parent = nullptr);
+
+    // instances of a service type like "_mqtt._tcp", found() is emitted for every address of every instance
+    void browse(const QString& service);
+    // addresses of a host name in the .local domain
+    void resolve(const QString& host, int port);
+
+ signals:
+    void found(const QHostAddress& address, int port);
+
+ private:
+    enum Type { A = 1, PTR = 12, AAAA = 28, SRV = 33 };
+
+    QUdpSocket*                         m_socket;
+    QHash<QString, int>                 m_ports;      // host name -> port of the service or resolve()
+    QHash<QString, QList<QHostAddress>> m_addresses;  // host name -> addresses received so far
+    QSet<QString>                       m_queried;    // names which were queried, answers are cached by the responders
+
+    void query(const QString& name, Type type);
+    void readDatagrams();
+    void parse(const QByteArray& packet);
+    void addAddress(const QString& host, const QHostAddress& address);
+    void setPort(const QString& host, int port);
+
+    static QString readName(const QByteArray& packet, int* offset);
+};
@@ -0,0 +1,126 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "metrics.h"
+
+#include <QFile>
+#include <QtAlgorithms>
+
+#include <cstring>
+
+static const char* OPERATION_NAMES[] = {"command", "message", "state", "config", "ack", "activity"};
+static const char* COUNTER_NAMES[] = {"publishes",       "messages",    "config_parses", "config_skipped",
+                                      "entity_rebuilds", "retransmits", "undelivered"};
+
+Metrics::Metrics() {
+    m_clock.start();
+    reset();
+}
+
+void Metrics::record(Operation operation, qint64 start) {
+    qint64     value = qMax(Q_INT64_C(0), (now() - start) / 1000);
+    Histogram &histogram = m_histograms[operation];
+    histogram.buckets[bucket(value)]++;
+    histogram.count++;
+    histogram.sum += value;
+    histogram.max = qMax(histogram.max, value);
+}
+
+void Metrics::reset() {
+    std::memset(m_histograms, 0, sizeof(m_histograms));
+    std::memset(m_counters, 0, sizeof(m_counters));
+    m_peakMemory = -1;
+}
+
+QVariantMap Metrics::snapshot() const {
+    QVariantMap map;
+    for (int i = 0; i < OPERATION_COUNT; i++) {
+        const Histogram &histogram = m_histograms[i];
+        QVariantMap      operation;
+        operation.insert("count", histogram.count);
+        operation.insert("mean", histogram.count > 0 ? histogram.sum / static_cast<qint64>(histogram.count) : 0);
+        operation.insert("p50", percentile(histogram, 0.5));
+        operation.insert("p95", percentile(histogram, 0.95));
+        operation.insert("p99", percentile(histogram, 0.99));
+        operation.insert("max", histogram.max);
+        map.insert(OPERATION_NAMES[i], operation);
+    }
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        map.insert(COUNTER_NAMES[i], m_counters[i]);
+    }
+    return map;
+}
+
+static qint64 memoryStatus(const char *field) {
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) {
+        return -1;
+    }
+    // e.g. "VmHWM:     12345 kB"
+    for (QByteArray line = status.readLine(); !line.isEmpty(); line = status.readLine()) {
+        if (line.startsWith(field)) {
+            return line.mid(static_cast<int>(std::strlen(field))).trimmed().split(' ').value(0).toLongLong();
+        }
+    }
+    return -1;
+}
+
+qint64 Metrics::currentMemory() { return memoryStatus("VmRSS:"); }
+
+qint64 Metrics::processPeakMemory() { return memoryStatus("VmHWM:"); }
+
+void Metrics::sampleMemory() { m_peakMemory = qMax(m_peakMemory, currentMemory()); }
+
+int Metrics::bucket(qint64 value) {
+    if (value < 4) {
+        return static_cast<int>(value);
+    }
+    int exponent = 63 - static_cast<int>(qCountLeadingZeroBits(static_cast<quint64>(value)));
+    int index = 4 + (exponent - 2) * 4 + static_cast<int>((value >> (exponent - 2)) & 3);
+    return qMin(index, BUCKETS - 1);
+}
+
+qint64 Metrics::bucketLimit(int bucket) {
+    // largest value falling into the bucket
+    if (bucket < 4) {
+        return bucket;
+    }
+    int exponent = (bucket - 4) / 4 + 2;
+    int sub = (bucket - 4) % 4;
+    return ((Q_INT64_C(5) + sub) << (exponent - 2)) - 1;
+}
+
+qint64 Metrics::percentile(const Histogram &histogram, double fraction) {
+    if (histogram.count == 0) {
+        return 0;
+    }
+    quint64 rank = static_cast<quint64>(fraction * histogram.count + 0.5);
+    quint64 seen = 0;
+    for (int i = 0; i < BUCKETS; i++) {
+        seen += histogram.buckets[i];
+        if (seen >= rank && seen > 0) {
+            return qMin(bucketLimit(i), histogram.max);
+        }
+    }
+    return histogram.max;
+}
@@ -0,0 +1,98 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <QVariantMap>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// METRICS
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Latency histograms and counters of the integration's hot paths.
+// Durations are taken from the monotonic clock and recorded into fixed logarithmic buckets (4 per power of two,
+// i.e. at most 25% error), so recording is a few arithmetic operations without allocation and the percentiles can be
+// read at any time.
+class Metrics {
+ public:
+    enum Operation {
+        Command,   // sendCommand until the publish was handed to the client or queued
+        Message,   // handling of one received message
+        State,     // state message received until applied to the entity
+        Config,    // parsing and applying one config message
+        Ack,       // QoS 1/2 publish until acknowledged by the broker, including retransmits
+        Activity,  // activity macro started until all its steps are finished
+        OPERATION_COUNT
+    };
+
+    enum Counter {
+        Publishes,
+        Messages,
+        ConfigParses,
+        ConfigSkipped,
+        EntityRebuilds,
+        Retransmits,  // QoS 1/2 publishes sent again after the acknowledgement timeout
+        Undelivered,  // QoS 1/2 publishes given up after the last attempt
+        COUNTER_COUNT
+    };
+
+    Metrics();
+
+    // monotonic timestamp in ns
+    qint64 now() const { return m_clock.nsecsElapsed(); }
+    void   record(Operation operation, qint64 start);
+    void   increment(Counter counter, int count = 1) { m_counters[counter] += count; }
+    void   reset();
+
+    // percentiles and counts of all operations, durations in µs
+    QVariantMap snapshot() const;
+
+    // Resident memory in kB, -1 where unknown (Linux only). The peak of the process is never reset: it belongs to the
+    // whole application. The sampled peak is the largest memory seen by sampleMemory() since the last reset.
+    static qint64 currentMemory();
+    static qint64 processPeakMemory();
+    void          sampleMemory();
+    qint64        peakMemory() const { return m_peakMemory; }
+
+ private:
+    static const int BUCKETS = 128;
+
+    struct Histogram {
+        quint32 buckets[BUCKETS];
+        quint64 count;
+        qint64  sum;  // µs
+        qint64  max;  // µs
+    };
+
+    QElapsedTimer m_clock;
+    Histogram     m_histograms[OPERATION_COUNT];
+    quint64       m_counters[COUNTER_COUNT];
+    qint64        m_peakMemory;  // kB, -1: not sampled yet
+
+    static int    bucket(qint64 value);
+    static qint64 bucketLimit(int bucket);
+    static qint64 percentile(const Histogram& histogram, double fraction);
+};
@@ -25,13 +25,25 @@
 
 #include "mqtt.h"
 
-#include <QJsonArray>
+#include <algorithm>
+
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFutureWatcher>
 #include <QJsonDocument>
 #include <QMetaType>
 #include <QNetworkInterface>
+#include <QRandomGenerator>
+#include <QSaveFile>
+#include <QSettings>
+#include <QSharedPointer>
+#include <QStandardPaths>
 #include <QtDebug>
 
 #include "math.h"
+#include "topicrouter.h"
 #include "yio-interface/entities/blindinterface.h"
 #include "yio-interface/entities/climateinterface.h"
 #include "yio-interface/entities/lightinterface.h"
@@ -55,282 +67,759 @@ Integration *MqttPlugin::createIntegration(const QVariantMap &config, EntitiesIn
 
 Mqtt::Mqtt(const QVariantMap &config, EntitiesInterface *entities, NotificationsInterface *notifications,
            YioAPIInterface *api, ConfigInterface *configObj, Plugin *plugin)
-    : Integration(config, entities, notifications, api, configObj, plugin) {
+    : Integration(config, entities, notifications, api, configObj, plugin),
+      m_compiler(m_logCategory, &Mqtt::stateAttribute) {
     for (QVariantMap::const_iterator iter = config.begin(); iter != config.end(); ++iter) {
         if (iter.key() == Integration::OBJ_DATA) {
             QVariantMap map = iter.value().toMap();
             m_ip = map.value(Integration::KEY_DATA_IP).toString();
+            m_keepAlive = map.value("keep_alive", 60).toInt();
+            // opt-in: a different keep-alive in standby costs a reconnect when entering standby
+            m_standbyKeepAlive = map.value("standby_keep_alive", m_keepAlive).toInt();
+            m_standbyUnsubscribeStates = map.value("standby_unsubscribe_states", true).toBool();
+            m_persistentSession = map.value("persistent_session", false).toBool();
+            m_mqtt5 = map.value("mqtt5", false).toBool();
+            m_statsInterval = map.value("stats_interval", 0).toInt();
+            m_lazyEntities = map.value("lazy_entities", false).toBool();
+            m_compiler.readButtonAliases(map.value("button_aliases").toMap());
+            m_topicAliasLimit = qBound(0, map.value("topic_aliases", 16).toInt(), 0xFFFF);
+            readBridges(map.value("bridges").toList());
         }
     }
+    if (m_bridges.isEmpty()) {
+        readBridges(QVariantList());
+    }
     m_initialized = false;
-    m_mqttReconnectTimer = new QTimer(this);
-    m_entityButtons = new QMap<QString, QList<Button> *>();
-    m_buttonFeatureMap = new QMap<QString, QString>();
-    m_buttonFeatureMap->insert("PLAY", "PLAY");
-    m_buttonFeatureMap->insert("PAUSE", "PAUSE");
-    m_buttonFeatureMap->insert("PLAY_PAUSE_TOGGLE", "PLAYTOGGLE");
-    m_buttonFeatureMap->insert("STOP", "STOP");
-    m_buttonFeatureMap->insert("FORWARD", "FORWARD");
-    m_buttonFeatureMap->insert("REVERSE", "BACKWARD");
-    m_buttonFeatureMap->insert("NEXT", "NEXT");
-    m_buttonFeatureMap->insert("PREVIOUS", "PREVIOUS");
-    m_buttonFeatureMap->insert("INFO", "INFO");
-    m_buttonFeatureMap->insert("MY_RECORDINGS", "RECORDINGS");
-    m_buttonFeatureMap->insert("RECORD", "RECORD");
-    m_buttonFeatureMap->insert("LIVE", "LIVE");
-    m_buttonFeatureMap->insert("DIGIT_0", "DIGIT_0");
-    m_buttonFeatureMap->insert("DIGIT_1", "DIGIT_1");
-    m_buttonFeatureMap->insert("DIGIT_2", "DIGIT_2");
-    m_buttonFeatureMap->insert("DIGIT_3", "DIGIT_3");
-    m_buttonFeatureMap->insert("DIGIT_4", "DIGIT_4");
-    m_buttonFeatureMap->insert("DIGIT_5", "DIGIT_5");
-    m_buttonFeatureMap->insert("DIGIT_6", "DIGIT_6");
-    m_buttonFeatureMap->insert("DIGIT_7", "DIGIT_7");
-    m_buttonFeatureMap->insert("DIGIT_8", "DIGIT_8");
-    m_buttonFeatureMap->insert("DIGIT_9", "DIGIT_9");
-    m_buttonFeatureMap->insert("DIGIT_10", "DIGIT_10");
-    m_buttonFeatureMap->insert("DIGIT_10PLUS", "DIGIT_10plus");
-    m_buttonFeatureMap->insert("DIGIT_11", "DIGIT_11");
-    m_buttonFeatureMap->insert("DIGIT_12", "DIGIT_12");
-    m_buttonFeatureMap->insert("DIGIT_SEPARATOR", "DIGIT_SEPARATOR");
-    m_buttonFeatureMap->insert("DIGIT_ENTER", "DIGIT_ENTER");
-    m_buttonFeatureMap->insert("CURSOR_UP", "CURSOR_UP");
-    m_buttonFeatureMap->insert("CURSOR_DOWN", "CURSOR_DOWN");
-    m_buttonFeatureMap->insert("CURSOR_LEFT", "CURSOR_LEFT");
-    m_buttonFeatureMap->insert("CURSOR_RIGHT", "CURSOR_RIGHT");
-    m_buttonFeatureMap->insert("CURSOR_ENTER", "CURSOR_OK");
-    m_buttonFeatureMap->insert("BACK", "BACK");
-    m_buttonFeatureMap->insert("MENU_HOME", "HOME");
-    m_buttonFeatureMap->insert("MENU", "GUIDE");
-    m_buttonFeatureMap->insert("EXIT", "EXIT");
-    m_buttonFeatureMap->insert("APP", "APP");
-    m_buttonFeatureMap->insert("POWEROFF", "POWER_OFF");
-    m_buttonFeatureMap->insert("POWERON", "POWER_ON");
-    m_buttonFeatureMap->insert("POWERTOGGLE", "POWER_TOGGLE");
-    m_buttonFeatureMap->insert("CHANNEL_UP", "CHANNEL_UP");
-    m_buttonFeatureMap->insert("CHANNEL_DOWN", "CHANNEL_DOWN");
-    m_buttonFeatureMap->insert("CHANNEL_SEARCH", "CHANNEL_SEARCH");
-    m_buttonFeatureMap->insert("FAVORITE", "FAVORITE");
-    m_buttonFeatureMap->insert("GUIDE", "MENU");
-    m_buttonFeatureMap->insert("FUNCTION_RED", "FUNCTION_RED");
-    m_buttonFeatureMap->insert("FUNCTION_GREEN", "FUNCTION_GREEN");
-    m_buttonFeatureMap->insert("FUNCTION_YELLOW", "FUNCTION_YELLOW");
-    m_buttonFeatureMap->insert("FUNCTION_BLUE", "FUNCTION_BLUE");
-    m_buttonFeatureMap->insert("FUNCTION_ORANGE", "FUNCTION_ORANGE");
-    m_buttonFeatureMap->insert("FORMAT_16_9", "FORMAT_16_9");
-    m_buttonFeatureMap->insert("FORMAT_4_3", "FORMAT_4_3");
-    m_buttonFeatureMap->insert("FORMAT_AUTO", "FORMAT_AUTO");
-    m_buttonFeatureMap->insert("VOLUME_UP", "VOLUME_UP");
-    m_buttonFeatureMap->insert("VOLUME_DOWN", "VOLUME_DOWN");
-    m_buttonFeatureMap->insert("MUTE_TOGGLE", "MUTE_TOGGLE");
-    m_buttonFeatureMap->insert("SOURCE", "SOURCE");
-    m_buttonFeatureMap->insert("INPUT_TUNER_1", "INPUT_TUNER_1");
-    m_buttonFeatureMap->insert("INPUT_TUNER_2", "INPUT_TUNER_2");
-    m_buttonFeatureMap->insert("INPUT_TUNER_Y", "INPUT_TUNER_X");
-    m_buttonFeatureMap->insert("INPUT_HDMI_1", "INPUT_HDMI_1");
-    m_buttonFeatureMap->insert("INPUT_HDMI_2", "INPUT_HDMI_2");
-    m_buttonFeatureMap->insert("INPUT_HDMI_X", "INPUT_HDMI_X");
-    m_buttonFeatureMap->insert("INPUT_X_1", "INPUT_X_1");
-    m_buttonFeatureMap->insert("INPUT_X_2", "INPUT_X_2");
-    m_buttonFeatureMap->insert("OUTPUT_HDMI_1", "OUTPUT_HDMI_1");
-    m_buttonFeatureMap->insert("OUTPUT_HDMI_2", "OUTPUT_HDMI_2");
-    m_buttonFeatureMap->insert("OUTPUT_DVI_1", "OUTPUT_DVI_1");
-    m_buttonFeatureMap->insert("OUTPUT_AUDIO_X", "OUTPUT_AUDIO_X");
-    m_buttonFeatureMap->insert("OUTPUT_X", "OUTPUT_X");
-    m_buttonFeatureMap->insert("NETFLIX", "SERVICE_NETFLIX");
-    m_buttonFeatureMap->insert("HULU", "SERVICE_HULU");
-}
-
-void Mqtt::createButtons(QVariantMap *buttons, bool updateEntity, QString entityId, QString deviceName,
-                         QStringList *supportedFeatures, QStringList *customFeatures) {
-    // iterate through all buttons
-    for (QVariantMap::const_iterator button = buttons->begin(); button != buttons->end(); ++button) {
-        QString buttonName = button.key();
-        QString buttonTopic = entityId.startsWith("MQTT_DEVICE") ? button.value().toList()[0].toString()
-                                                                 : button.value().toList()[1].toString();
-        QVariant buttonPayload =
-            entityId.startsWith("MQTT_DEVICE") ? button.value().toList()[1] : button.value().toList()[2];
-        QString buttonPayloadString = "";
-        switch (buttonPayload.userType()) {
-            case QMetaType::QString:
-                buttonPayloadString = buttonPayload.toString();
-                break;
-            case QMetaType::QVariantMap:
-                buttonPayloadString =
-                    QString(QJsonDocument::fromVariant(buttonPayload.toMap()).toJson()).replace('\n', "");
-                break;
-        }
-        Button b = Button(buttonName, buttonTopic, buttonPayloadString);
-        if (!m_entityButtons->contains(entityId)) {
-            m_entityButtons->insert(entityId, new QList<Button>({b}));
-        } else {
-            m_entityButtons->value(entityId)->append(b);
-        }
+    m_standby = false;
+    m_pendingStatesSince = -1;
+    m_statsTimer = nullptr;
+    m_currentActivityChanged = false;
+
+    m_stateTimer = new QTimer(this);
+    m_stateTimer->setSingleShot(true);
+    m_stateTimer->setInterval(STATE_UPDATE_INTERVAL);
+    QObject::connect(m_stateTimer, &QTimer::timeout, this, &Mqtt::applyStates);
+
+    // restore the entities of the last run so they are usable before the broker answers
+    QString cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    m_snapshotPath = QString("%1/mqtt-%2.snapshot").arg(cacheDir, integrationId());
+    m_cache = new QSettings(QString("%1/mqtt-%2.ini").arg(cacheDir, integrationId()), QSettings::IniFormat, this);
+    m_snapshotTimer = new QTimer(this);
+    m_snapshotTimer->setSingleShot(true);
+    m_snapshotTimer->setInterval(2000);
+    QObject::connect(m_snapshotTimer, &QTimer::timeout, this, &Mqtt::saveSnapshot);
+    loadSnapshot();
+}
 
-        supportedFeature(buttonName, supportedFeatures);
-        customFeatures->append(buttonName);
+Mqtt::~Mqtt() {
+    // the compile jobs use the settings of this object
+    for (QFuture<void> &compilation : m_compilations) {
+        compilation.waitForFinished();
     }
-    if (updateEntity) {
-        qCInfo(m_logCategory) << "updating entity:" << entityId << "with custom features:" << *customFeatures;
-        // if the entity is already in the list, skip
-        for (int i = 0; i < m_allAvailableEntities.length(); i++) {
-            if (m_allAvailableEntities[i].toMap().value(Integration::KEY_ENTITY_ID).toString() == entityId) {
-                QVariantMap entityMap = m_allAvailableEntities[i].toMap();
-                entityMap[Integration::KEY_SUPPORTED_FEATURES] = *supportedFeatures;
-                if (customFeatures->size() > 0) {
-                    entityMap[Integration::KEY_CUSTOM_FEATURES] = *customFeatures;
+}
+
+void Mqtt::readBridges(const QVariantList &bridges) {
+    // without a bridge list there is one bridge on the broker of the ip setting, using the default topic prefix
+    QVariantList list = bridges.isEmpty() ? QVariantList({QVariantMap()}) : bridges;
+    for (const QVariant &item : list) {
+        QVariantMap map = item.toMap();
+        Bridge      bridge;
+        bridge.name = map.value("name").toString();
+        bridge.prefix = map.value("prefix", "mqtt_urc").toString();
+        while (bridge.prefix.endsWith('/')) {
+            bridge.prefix.chop(1);
+        }
+        // the name is part of the entity ids, a duplicate is replaced by the prefix or, if that is taken as well,
+        // by the prefix with a number
+        auto taken = [this](const QString &name) {
+            for (const Bridge &other : m_bridges) {
+                if (other.name == name) {
+                    return true;
                 }
             }
+            return false;
+        };
+        if (taken(bridge.name)) {
+            QString name = bridge.prefix;
+            for (int i = 2; taken(name); i++) {
+                name = QString("%1_%2").arg(bridge.prefix).arg(i);
+            }
+            qCWarning(m_logCategory) << "bridge name" << bridge.name << "is not unique, using" << name;
+            bridge.name = name;
         }
-    } else {
-        qCInfo(m_logCategory) << "adding entity:" << entityId << "with custom features:" << *customFeatures;
-        addAvailableEntity(entityId, "remote", integrationId(), deviceName, *supportedFeatures, *customFeatures);
-    }
-}
-
-void Mqtt::handleDevices(const QVariantMap &map) {
-    qCInfo(m_logCategory) << "converting devices to map";
-    QVariantMap devices = map.value("devices").toMap();
-
-    // iterate through all devices
-    for (QVariantMap::const_iterator device = devices.begin(); device != devices.end(); ++device) {
-        QString deviceName = device.key();
-        QString entityId = QString("MQTT_DEVICE.").append(deviceName);
-        bool    updateEntity = false;
-        if (m_entityButtons->contains(entityId)) {
-            updateEntity = true;
-            m_entityButtons->value(entityId)->clear();
-        }
-        QStringList supportedFeatures = QStringList();
-        QStringList customFeatures = QStringList();
-        qCInfo(m_logCategory) << "device:" << deviceName;
-        QVariantMap buttons = device.value().toMap().value("Buttons").toMap();
-        createButtons(&buttons, updateEntity, entityId, deviceName, &supportedFeatures, &customFeatures);
-    }
-}
-
-void Mqtt::handleActivities(const QVariantMap &map) {
-    qCInfo(m_logCategory) << "converting activites to map";
-    QVariantMap activities = map.value("activities").toMap();
-
-    // iterate through all activites
-    for (QVariantMap::const_iterator activity = activities.begin(); activity != activities.end(); ++activity) {
-        QString activityName = activity.key();
-        QString entityId = QString("MQTT_ACTIVITY.").append(activityName);
-        bool    updateEntity = false;
-        if (m_entityButtons->contains(entityId)) {
-            updateEntity = true;
-            m_entityButtons->value(entityId)->clear();
-        }
-        qCInfo(m_logCategory) << "activity:" << activityName;
-        QStringList supportedFeatures = QStringList();
-        QStringList customFeatures = QStringList();
-
-        // activation and deactivation buttons
-        QVariant activation = activity.value().toMap().value("activation").toList()[0];
-        QVariant deactivation = activity.value().toMap().value("deactivation").toList()[0];
-        QString  activationPayloadString = QString(QJsonDocument::fromVariant(activation).toJson()).replace('\n', "");
-        QString  deactivationPayloadString =
-            QString(QJsonDocument::fromVariant(deactivation).toJson()).replace('\n', "");
-        qCInfo(m_logCategory) << "activation payload:" << activationPayloadString;
-        qCInfo(m_logCategory) << "deactivation payload:" << deactivationPayloadString;
-        Button activationButton = Button("POWERON", "mqtt_urc/activity", activationPayloadString);
-        if (!m_entityButtons->contains(entityId)) {
-            m_entityButtons->insert(entityId, new QList<Button>({activationButton}));
+        bridge.connection = addConnection(map.value("ip", m_ip).toString());
+        // the messages of a connection are routed by topic, so a prefix can only be used once per broker
+        bool duplicate = false;
+        for (const Bridge &other : m_bridges) {
+            duplicate |= other.connection == bridge.connection && other.prefix == bridge.prefix;
+        }
+        if (duplicate) {
+            qCWarning(m_logCategory) << "topic prefix" << bridge.prefix << "is already used on the broker,"
+                                     << "ignoring bridge" << bridge.name;
+            continue;
+        }
+        qCInfo(m_logCategory) << "bridge" << bridge.name << "topic prefix:" << bridge.prefix;
+        m_bridges.append(bridge);
+    }
+}
+
+int Mqtt::addConnection(const QString &ip) {
+    // bridges on the same broker share the connection
+    QStringList hostnamePort = ip.split(":");
+    QString     hostname = hostnamePort[0];
+    int         port = (hostnamePort.size() == 2) ? hostnamePort[1].toInt() : 1883;
+    for (int i = 0; i < m_connections.size(); i++) {
+        if (m_connections[i].hostname == hostname && m_connections[i].port == port) {
+            return i;
+        }
+    }
+    Connection connection;
+    connection.hostname = hostname;
+    connection.port = port;
+    connection.router.reset(new TopicRouter);
+    m_connections.append(connection);
+    return m_connections.size() - 1;
+}
+
+QString Mqtt::entityId(int bridge, const QString &kind, const QString &name) const {
+    return EntityCompiler::entityId(m_bridges[bridge].name, kind, name);
+}
+
+Mqtt::CompileJob Mqtt::compileJob(int bridge) const {
+    CompileJob job;
+    job.bridgeName = m_bridges[bridge].name;
+    job.activityTopic = m_bridges[bridge].prefix + "/activity";
+    job.entity.bridge = bridge;
+    return job;
+}
+
+void Mqtt::announceEntity(const QString &entityId, bool update) {
+    const EntityButtons &entity = m_entityButtons[entityId];
+    announceEntity(entityId, entity.friendlyName, entity.supportedFeatures, entity.customFeatures, update);
+}
+
+void Mqtt::announceEntity(const QString &entityId, const QString &name, const QStringList &supportedFeatures,
+                          const QStringList &customFeatures, bool update) {
+    if (!update) {
+        qCInfo(m_logCategory) << "adding entity:" << entityId << "with custom features:" << customFeatures;
+        addAvailableEntity(entityId, "remote", integrationId(), name, supportedFeatures, customFeatures);
+        return;
+    }
+    qCInfo(m_logCategory) << "updating entity:" << entityId << "with custom features:" << customFeatures;
+    // if the entity is already in the list, skip
+    for (int i = 0; i < m_allAvailableEntities.length(); i++) {
+        if (m_allAvailableEntities[i].toMap().value(Integration::KEY_ENTITY_ID).toString() == entityId) {
+            QVariantMap entityMap = m_allAvailableEntities[i].toMap();
+            bool        changed = entityMap.value(Integration::KEY_SUPPORTED_FEATURES) != supportedFeatures;
+            entityMap[Integration::KEY_SUPPORTED_FEATURES] = supportedFeatures;
+            if (customFeatures.size() > 0) {
+                changed |= entityMap.value(Integration::KEY_CUSTOM_FEATURES) != customFeatures;
+                entityMap[Integration::KEY_CUSTOM_FEATURES] = customFeatures;
+            }
+            // only touch the available entity list if the features really changed
+            if (changed) {
+                m_allAvailableEntities[i] = entityMap;
+            }
+            break;
+        }
+    }
+}
+
+void Mqtt::removeStaleEntities(int bridge, const QString &prefix, const QSet<QString> &entityIds) {
+    for (auto iter = m_entityButtons.begin(); iter != m_entityButtons.end();) {
+        if (iter->bridge == bridge && iter.key().startsWith(prefix) && !entityIds.contains(iter.key())) {
+            qCInfo(m_logCategory) << "removing entity:" << iter.key();
+            unbindStates(iter.key());
+            removeFromCatalog(iter.key());
+            iter = m_entityButtons.erase(iter);
         } else {
-            m_entityButtons->value(entityId)->append(activationButton);
+            ++iter;
         }
-        Button deactivationButton = Button("POWEROFF", "mqtt_urc/activity", deactivationPayloadString);
-        if (!m_entityButtons->contains(entityId)) {
-            m_entityButtons->insert(entityId, new QList<Button>({deactivationButton}));
+    }
+    for (auto iter = m_rawEntities.begin(); iter != m_rawEntities.end();) {
+        if (iter->bridge == bridge && iter.key().startsWith(prefix) && !entityIds.contains(iter.key())) {
+            qCInfo(m_logCategory) << "removing entity:" << iter.key();
+            removeFromCatalog(iter.key());
+            iter = m_rawEntities.erase(iter);
         } else {
-            m_entityButtons->value(entityId)->append(deactivationButton);
+            ++iter;
+        }
+    }
+}
+
+void Mqtt::removeFromCatalog(const QString &entityId) {
+    for (int i = 0; i < m_allAvailableEntities.length(); i++) {
+        if (m_allAvailableEntities[i].toMap().value(Integration::KEY_ENTITY_ID).toString() == entityId) {
+            m_allAvailableEntities.removeAt(i);
+            break;
+        }
+    }
+}
+
+bool Mqtt::materializeEntity(const QString &entityId) {
+    auto raw = m_rawEntities.find(entityId);
+    if (raw == m_rawEntities.end()) {
+        return false;
+    }
+    qCInfo(m_logCategory) << "building entity on first use:" << entityId;
+    CompileJob job = compileJob(raw->bridge);
+    job.entityId = entityId;
+    job.name = raw->name;
+    job.config = raw->config;
+    m_rawEntities.erase(raw);
+    m_compiler.compile(&job);
+    for (Button &button : job.entity.buttons) {
+        button = m_buttonArena.copy(job.arena, button);
+    }
+    m_entityButtons.insert(entityId, job.entity);
+    announceEntity(entityId, true);
+    bindStates(entityId);
+    if (entityId.startsWith("MQTT_ACTIVITY")) {
+        updateActivities();
+    }
+    m_snapshotTimer->start();
+    m_metrics.sampleMemory();
+    return true;
+}
+
+void Mqtt::materializeConfiguredEntities() {
+    // entities placed in the UI are built right away, the others on first use
+    for (const QString &entityId : m_rawEntities.keys()) {
+        if (m_entities->getEntityInterface(entityId) != nullptr) {
+            materializeEntity(entityId);
         }
-        customFeatures.append("POWER_ON");
-        customFeatures.append("POWER_OFF");
-        supportedFeatures.append("POWER_ON");
-        supportedFeatures.append("POWER_OFF");
+    }
+}
+
+void Mqtt::messageReceived(int connection, const QByteArray &message, const QMqttTopicName &topic) {
+    qint64 start = m_metrics.now();
+    m_metrics.increment(Metrics::Messages);
+    qCDebug(m_logCategory) << "message received on topic:" << topic.name();
+    configReplyReceived(connection, topic.name());
+
+    // messages are matched on their topic only, the handlers decode the payload
+    if (m_connections[connection].router->route(message, topic) == 0) {
+        qCDebug(m_logCategory) << "no handler for topic:" << topic.name();
+    }
+    m_metrics.record(Metrics::Message, start);
+}
 
-        // iterate through all buttons
-        QVariantMap buttons = activity.value().toMap().value("buttons").toMap();
-        createButtons(&buttons, updateEntity, entityId, activityName, &supportedFeatures, &customFeatures);
+void Mqtt::currentActivityReceived(int bridge, const QByteArray &message) {
+    m_bridges[bridge].currentActivity = entityId(bridge, "MQTT_ACTIVITY", QString(message));
+    m_currentActivityChanged = true;
+    qCDebug(m_logCategory) << "current activity" << m_bridges[bridge].currentActivity;
+    if (!m_stateTimer->isActive()) {
+        m_stateTimer->start();
+    }
+}
+
+void Mqtt::bindStates(const QString &entityId) {
+    const EntityButtons &entity = m_entityButtons[entityId];
+    QString              targetId = entity.stateEntityId.isEmpty() ? entityId : entity.stateEntityId;
+    int                  connection = m_bridges[entity.bridge].connection;
+    QMqttClient         *client = m_connections[connection].client;
+    for (const QPair<QString, int> &state : entity.stateTopics) {
+        QVector<StateBinding> &bindings = m_stateBindings[state.first];
+        // state topics are subscribed and routed on the broker of the entity's bridge
+        if (!boundOn(bindings, connection)) {
+            QString filter = state.first;
+            m_connections[connection].router->addRoute(
+                filter, [this, connection, filter](const QByteArray &message, const QMqttTopicName &) {
+                    stateReceived(connection, message, filter);
+                });
+            if (client != nullptr && client->state() == QMqttClient::Connected && statesSubscribed()) {
+                client->subscribe(QMqttTopicFilter(state.first), subscriptionQos());
+            }
+        }
+        bindings.append({entityId, targetId, state.second, connection});
+    }
+}
+
+void Mqtt::unbindStates(const QString &entityId) {
+    // a power state is only trusted while it is reported on a state topic
+    m_powerStates.remove(entityId);
+    for (const QPair<QString, int> &state : m_entityButtons.value(entityId).stateTopics) {
+        auto bindings = m_stateBindings.find(state.first);
+        if (bindings == m_stateBindings.end()) {
+            continue;
+        }
+        int  connection = m_bridges[m_entityButtons.value(entityId).bridge].connection;
+        auto isEntity = [&entityId](const StateBinding &binding) { return binding.entityId == entityId; };
+        bindings->erase(std::remove_if(bindings->begin(), bindings->end(), isEntity), bindings->end());
+        QMqttClient *client = m_connections[connection].client;
+        if (!boundOn(*bindings, connection)) {
+            m_connections[connection].router->removeRoutes(state.first);
+            if (client != nullptr && client->state() == QMqttClient::Connected) {
+                client->unsubscribe(QMqttTopicFilter(state.first));
+            }
+        }
+        if (bindings->isEmpty()) {
+            m_stateBindings.erase(bindings);
+        }
     }
 }
 
-void Mqtt::messageReceived(const QByteArray &message, const QMqttTopicName &topic) {
-    qCInfo(m_logCategory) << "message received on topic: " + topic.name();  // + " payload: " << QString(message);
+bool Mqtt::boundOn(const QVector<StateBinding> &bindings, int connection) {
+    for (const StateBinding &binding : bindings) {
+        if (binding.connection == connection) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Mqtt::subscribeStates(int connection) {
+    for (auto iter = m_stateBindings.constBegin(); iter != m_stateBindings.constEnd(); ++iter) {
+        if (boundOn(*iter, connection)) {
+            m_connections[connection].client->subscribe(QMqttTopicFilter(iter.key()), subscriptionQos());
+        }
+    }
+}
+
+void Mqtt::unsubscribeStates(int connection) {
+    for (auto iter = m_stateBindings.constBegin(); iter != m_stateBindings.constEnd(); ++iter) {
+        if (boundOn(*iter, connection)) {
+            m_connections[connection].client->unsubscribe(QMqttTopicFilter(iter.key()));
+        }
+    }
+}
+
+bool Mqtt::statesSubscribed() const { return !(m_standby && m_standbyUnsubscribeStates); }
+
+quint8 Mqtt::subscriptionQos() const {
+    // the broker only queues QoS 1 messages for an offline session. A resumed session keeps its subscriptions, so
+    // the retained messages are not sent again: without the queue, states changed while offline would stay stale.
+    return m_persistentSession ? 1 : 0;
+}
+
+void Mqtt::stateReceived(int connection, const QByteArray &message, const QString &filter) {
+    for (const StateBinding &binding : m_stateBindings.value(filter)) {
+        if (binding.connection != connection) {
+            continue;
+        }
+        QVariant value = stateValue(binding.attribute, message);
+        if (binding.attribute == STATE_POWER) {
+            // used by activity macros to skip switching devices which already are in the target state
+            m_powerStates.insert(binding.entityId, value.toBool());
+        }
+        queueState(binding.targetId, binding.attribute, value);
+    }
+}
+
+void Mqtt::queueState(const QString &entityId, int attribute, const QVariant &value) {
+    // only the latest value is kept, bursts of state messages result in a single update
+    m_pendingStates[entityId].insert(attribute, value);
+    if (m_pendingStatesSince < 0) {
+        m_pendingStatesSince = m_metrics.now();
+    }
+    if (!m_stateTimer->isActive()) {
+        m_stateTimer->start();
+    }
+}
 
-    if (topic.name() == "mqtt_urc/config/current_activity") {
-        QString currentActivity = QString("MQTT_ACTIVITY.").append(QString(message));
-        qCInfo(m_logCategory) << "current activity" << currentActivity;
-        for (auto const &act : m_entityButtons->keys()) {
-            if (act.startsWith("MQTT_ACTIVITY")) {
-                if (act != currentActivity) {
-                    if (m_entities->getEntityInterface(act) != nullptr && m_entities->getEntityInterface(act)->isOn()) {
-                        qCInfo(m_logCategory) << "set state offline for activity" << act;
-                        m_entities->getEntityInterface(act)->setState(RemoteDef::States::OFFLINE);
-                    }
+void Mqtt::applyStates() {
+    if (m_currentActivityChanged) {
+        applyCurrentActivity();
+    }
+    for (auto entity = m_pendingStates.constBegin(); entity != m_pendingStates.constEnd(); ++entity) {
+        EntityInterface *target = entityInterface(entity.key());
+        if (target == nullptr) {
+            continue;
+        }
+        // the attribute indices are those of a media player, other entity types only get the power state
+        QString type = target->type();
+        for (auto attribute = entity->constBegin(); attribute != entity->constEnd(); ++attribute) {
+            if (attribute.key() != STATE_POWER) {
+                if (type == "media_player") {
+                    target->updateAttrByIndex(attribute.key(), attribute.value());
                 } else {
-                    if (m_entities->getEntityInterface(act) != nullptr &&
-                        m_entities->getEntityInterface(act)->state() != RemoteDef::States::ONLINE) {
-                        qCInfo(m_logCategory) << "set state online for activity" << act;
-                        m_entities->getEntityInterface(act)->setState(RemoteDef::States::ONLINE);
-                    }
+                    qCWarning(m_logCategory) << "state attribute" << attribute.key() << "not supported by" << type
+                                             << entity.key();
                 }
+                continue;
+            }
+            int state = powerState(type, attribute.value().toBool());
+            if (state == STATE_UNSUPPORTED) {
+                qCWarning(m_logCategory) << "power state not supported by" << type << entity.key();
+                continue;
+            }
+            if (target->state() != state) {
+                qCDebug(m_logCategory) << "set state" << state << "for" << entity.key();
+                target->setState(state);
             }
         }
-        return;
     }
+    m_pendingStates.clear();
+    if (m_pendingStatesSince >= 0) {
+        m_metrics.record(Metrics::State, m_pendingStatesSince);
+        m_pendingStatesSince = -1;
+    }
+}
 
-    QJsonParseError parseerror;
-    QJsonDocument   doc = QJsonDocument::fromJson(message, &parseerror);
-    if (parseerror.error != QJsonParseError::NoError) {
-        qCCritical(m_logCategory) << "JSON error:" << parseerror.errorString();
+void Mqtt::applyCurrentActivity() {
+    m_currentActivityChanged = false;
+    for (ActivityHandle &activity : m_activities) {
+        if (activity.entity == nullptr) {
+            activity.entity = entityInterface(activity.entityId);
+            if (activity.entity == nullptr) {
+                continue;
+            }
+        }
+        if (activity.entityId != m_bridges[activity.bridge].currentActivity) {
+            if (activity.entity->isOn()) {
+                qCDebug(m_logCategory) << "set state offline for activity" << activity.entityId;
+                activity.entity->setState(RemoteDef::States::OFFLINE);
+            }
+        } else if (activity.entity->state() != RemoteDef::States::ONLINE) {
+            qCDebug(m_logCategory) << "set state online for activity" << activity.entityId;
+            activity.entity->setState(RemoteDef::States::ONLINE);
+        }
+    }
+}
+
+EntityInterface *Mqtt::entityInterface(const QString &entityId) {
+    // handles are resolved once and kept until the entity is rebuilt, removed or the integration disconnects
+    auto entity = m_entityButtons.find(entityId);
+    if (entity != m_entityButtons.end()) {
+        if (entity->entity == nullptr) {
+            entity->entity = m_entities->getEntityInterface(entityId);
+        }
+        return entity->entity;
+    }
+    EntityInterface *&external = m_externalEntities[entityId];
+    if (external == nullptr) {
+        external = m_entities->getEntityInterface(entityId);
+    }
+    return external;
+}
+
+void Mqtt::updateActivities() {
+    m_activities.clear();
+    for (auto iter = m_entityButtons.constBegin(); iter != m_entityButtons.constEnd(); ++iter) {
+        if (iter.key().startsWith("MQTT_ACTIVITY")) {
+            m_activities.append({iter.key(), iter->entity, iter->bridge});
+        }
+    }
+}
+
+void Mqtt::invalidateEntityHandles() {
+    m_externalEntities.clear();
+    for (auto iter = m_entityButtons.begin(); iter != m_entityButtons.end(); ++iter) {
+        iter->entity = nullptr;
+    }
+    for (ActivityHandle &activity : m_activities) {
+        activity.entity = nullptr;
+    }
+}
+
+int Mqtt::stateAttribute(const QString &name) {
+    if (name == "power") {
+        return STATE_POWER;
+    } else if (name == "volume") {
+        return MediaPlayerDef::VOLUME;
+    } else if (name == "muted") {
+        return MediaPlayerDef::MUTED;
+    } else if (name == "source" || name == "input") {
+        return MediaPlayerDef::SOURCE;
+    } else if (name == "title") {
+        return MediaPlayerDef::MEDIATITLE;
+    } else if (name == "artist") {
+        return MediaPlayerDef::MEDIAARTIST;
+    } else if (name == "image") {
+        return MediaPlayerDef::MEDIAIMAGE;
+    }
+    return STATE_UNSUPPORTED;
+}
+
+int Mqtt::powerState(const QString &type, bool on) {
+    if (type == "remote") {
+        return on ? RemoteDef::States::ONLINE : RemoteDef::States::OFFLINE;
+    } else if (type == "media_player") {
+        return on ? MediaPlayerDef::States::ON : MediaPlayerDef::States::OFF;
+    } else if (type == "light") {
+        return on ? LightDef::States::ON : LightDef::States::OFF;
+    } else if (type == "switch") {
+        return on ? SwitchDef::States::ON : SwitchDef::States::OFF;
+    }
+    return STATE_UNSUPPORTED;
+}
+
+QVariant Mqtt::stateValue(int attribute, const QByteArray &message) {
+    QByteArray value = message.trimmed();
+    if (attribute == STATE_POWER || attribute == MediaPlayerDef::MUTED) {
+        value = value.toLower();
+        return value == "on" || value == "1" || value == "true";
+    } else if (attribute == MediaPlayerDef::VOLUME) {
+        return qRound(value.toDouble());
+    }
+    return QString::fromUtf8(value);
+}
+
+void Mqtt::configReceived(const QByteArray &message, const QMqttTopicName &topic, const QString &rootKey,
+                          int bridge) {
+    // the bridge republishes the retained config on every reconnect: skip parsing if nothing changed at all
+    m_bridges[bridge].configValidated = true;
+    QByteArray messageHash = EntityCompiler::contentHash(message);
+    BridgeTopic configTopic(bridge, topic.name());
+    if (m_configHashes.value(configTopic) == messageHash) {
+        qCDebug(m_logCategory) << "config unchanged on topic:" << topic.name();
+        m_metrics.increment(Metrics::ConfigSkipped);
         return;
     }
+    QSharedPointer<ConfigCompilation> compilation(new ConfigCompilation);
+    compilation->topic = topic.name();
+    compilation->prefix = rootKey == "devices" ? "MQTT_DEVICE." : "MQTT_ACTIVITY.";
+    compilation->bridge = bridge;
+    compilation->generation = ++m_configGenerations[configTopic];
+    compilation->message = message;
+    compilation->messageHash = messageHash;
+    compilation->start = m_metrics.now();
+    m_metrics.increment(Metrics::ConfigParses);
 
-    QVariantMap map = doc.toVariant().toMap();
-    if (map.firstKey() == "devices" && topic.name() == "mqtt_urc/config/devices") {
-        handleDevices(map);
-    } else if (map.firstKey() == "activities" && topic.name() == "mqtt_urc/config/activities") {
-        handleActivities(map);
+    // here the message is only split into its devices or activities, which are compiled in parallel on the thread
+    // pool while commands keep using the current entities. The jobs are views into the message kept by the compilation.
+    if (!m_compiler.split(compilation->message, rootKey, compileJob(bridge), &compilation->jobs)) {
+        return;
     }
+    for (CompileJob &job : compilation->jobs) {
+        auto current = m_entityButtons.constFind(job.entityId);
+        if (current != m_entityButtons.constEnd()) {
+            job.previousHash = current->contentHash;
+        } else {
+            job.lazy = m_lazyEntities && m_entities->getEntityInterface(job.entityId) == nullptr;
+        }
+    }
+
+    QFutureWatcher<void> *watcher = new QFutureWatcher<void>(this);
+    QObject::connect(watcher, &QFutureWatcher<void>::finished, this, [this, watcher, compilation]() {
+        m_compilations.removeOne(watcher->future());
+        watcher->deleteLater();
+        applyConfig(compilation.data());
+    });
+    QFuture<void> future = m_compiler.compileAll(&compilation->jobs);
+    m_compilations.append(future);
+    watcher->setFuture(future);
 }
 
-QString Mqtt::buttonNameToSupportedFeatures(QString buttonName) {
-    QString name = buttonName.replace(' ', '_').toUpper();
+void Mqtt::applyConfig(ConfigCompilation *compilation) {
+    BridgeTopic configTopic(compilation->bridge, compilation->topic);
+    if (compilation->generation != m_configGenerations.value(configTopic)) {
+        qCDebug(m_logCategory) << "discarding outdated config of topic:" << compilation->topic;
+        return;
+    }
+    QSet<QString> entityIds;
+    for (const CompileJob &job : compilation->jobs) {
+        entityIds.insert(job.entityId);
+    }
+    removeStaleEntities(compilation->bridge, compilation->prefix, entityIds);
+
+    // the unparsed entities are taken from this message again
+    QSet<QString> catalog;
+    for (auto iter = m_rawEntities.begin(); iter != m_rawEntities.end();) {
+        if (iter->bridge == compilation->bridge && iter.key().startsWith(compilation->prefix)) {
+            catalog.insert(iter.key());
+            iter = m_rawEntities.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+    bool lazy = false;
+    for (CompileJob &job : compilation->jobs) {
+        // built on first use while this message was compiled
+        if (job.lazy && m_entityButtons.contains(job.entityId)) {
+            job.lazy = false;
+            job.entity.supportedFeatures.clear();
+            job.entity.customFeatures.clear();
+            m_compiler.compile(&job);
+        }
+        lazy |= job.lazy;
+    }
+
+    for (const CompileJob &job : compilation->jobs) {
+        if (job.lazy) {
+            continue;
+        }
+        if (job.unchanged) {
+            qCDebug(m_logCategory) << "unchanged:" << job.entityId;
+        } else if (m_entityButtons.contains(job.entityId)) {
+            unbindStates(job.entityId);
+            m_metrics.increment(Metrics::EntityRebuilds);
+        }
+    }
+    // the new model is built next to the one in use
+    QHash<QString, EntityButtons> entityButtons;
+    ButtonArena                   arena;
+    EntityCompiler::merge(&compilation->jobs, m_entityButtons, m_buttonArena, &entityButtons, &arena);
+
+    // a command sees either the old or the new model, never a mix
+    m_entityButtons.swap(entityButtons);
+    m_buttonArena.swap(arena);
 
-    if (m_buttonFeatureMap->contains(name)) {
-        return m_buttonFeatureMap->value(name);
+    for (const CompileJob &job : compilation->jobs) {
+        if (job.lazy) {
+            // only listed with its features until it is used
+            m_rawEntities.insert(job.entityId, {job.name, job.config, compilation->bridge,
+                                                job.entity.supportedFeatures, job.entity.customFeatures});
+            announceEntity(job.entityId, job.name, job.entity.supportedFeatures, job.entity.customFeatures,
+                           catalog.contains(job.entityId));
+        } else if (!job.unchanged) {
+            announceEntity(job.entityId, entityButtons.contains(job.entityId) || catalog.contains(job.entityId));
+            bindStates(job.entityId);
+        }
+    }
+    // the unparsed entities are views into the message
+    if (lazy) {
+        m_rawMessages.insert(configTopic, compilation->message);
     } else {
-        return "";
+        m_rawMessages.remove(configTopic);
+    }
+    if (compilation->prefix == "MQTT_ACTIVITY.") {
+        updateActivities();
+    }
+    m_configHashes.insert(configTopic, compilation->messageHash);
+    m_snapshotTimer->start();
+    m_metrics.record(Metrics::Config, compilation->start);
+    // the model grows with a config, the peak is sampled here instead of on every press
+    m_metrics.sampleMemory();
+}
+
+QStringList Mqtt::bridgeLayout() const {
+    QStringList layout;
+    for (const Bridge &bridge : m_bridges) {
+        layout << bridge.name << bridge.prefix;
     }
+    return layout;
 }
 
-QString Mqtt::supportedFeatureToButtonName(QString supportedFeature) {
-    for (auto const &key : m_buttonFeatureMap->keys()) {
-        if (m_buttonFeatureMap->value(key) == supportedFeature) {
-            return key;
+void Mqtt::loadSnapshot() {
+    QFile file(m_snapshotPath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qCInfo(m_logCategory) << "no entity snapshot found:" << m_snapshotPath;
+        return;
+    }
+    // streamed from the file, everything ends up deserialized into the model
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_12);
+
+    quint32 magic, version;
+    in >> magic >> version;
+    if (magic != SNAPSHOT_MAGIC || version != SNAPSHOT_VERSION) {
+        qCInfo(m_logCategory) << "ignoring entity snapshot with version" << version;
+        return;
+    }
+
+    // the supported features depend on the button aliases, the entity ids and config topics on the bridges
+    QHash<QString, int> buttonAliases;
+    QStringList         bridges;
+    in >> buttonAliases >> bridges;
+    if (buttonAliases != m_compiler.buttonAliases() || bridges != bridgeLayout()) {
+        qCInfo(m_logCategory) << "button aliases or bridges changed, ignoring entity snapshot";
+        return;
+    }
+
+    QHash<BridgeTopic, QByteArray> configHashes;
+    QHash<QString, EntityButtons>  entityButtons;
+    quint32                        entityCount;
+    in >> configHashes >> entityCount;
+    for (quint32 i = 0; i < entityCount && in.status() == QDataStream::Ok; i++) {
+        QString       entityId;
+        EntityButtons entity;
+        quint32       buttonCount;
+        in >> entityId >> entity.bridge >> entity.friendlyName >> entity.supportedFeatures >> entity.customFeatures
+           >> entity.contentHash >> entity.stateEntityId >> entity.stateTopics >> entity.activation
+           >> entity.deactivation >> buttonCount;
+        if (entity.bridge < 0 || entity.bridge >= m_bridges.size()) {
+            in.setStatus(QDataStream::ReadCorruptData);
+        }
+        for (quint32 j = 0; j < buttonCount && in.status() == QDataStream::Ok; j++) {
+            QString    name, topic;
+            QByteArray payload;
+            Button     options;
+            in >> name >> topic >> payload >> options.minInterval >> options.coalesce >> options.ttl >> options.qos
+               >> options.retain >> options.isTemplate;
+            m_compiler.addButton(&m_buttonArena, &entity, name, topic, payload, options);
+        }
+        entityButtons.insert(entityId, entity);
+    }
+    QHash<QString, RawEntity> rawEntities;
+    quint32                   rawCount = 0;
+    in >> rawCount;
+    for (quint32 i = 0; i < rawCount && in.status() == QDataStream::Ok; i++) {
+        QString   entityId;
+        RawEntity raw;
+        in >> entityId >> raw.bridge >> raw.name >> raw.config >> raw.supportedFeatures >> raw.customFeatures;
+        if (raw.bridge < 0 || raw.bridge >= m_bridges.size()) {
+            in.setStatus(QDataStream::ReadCorruptData);
         }
+        rawEntities.insert(entityId, raw);
+    }
+
+    if (in.status() != QDataStream::Ok) {
+        qCWarning(m_logCategory) << "entity snapshot is corrupt, ignoring it";
+        m_buttonArena.clear();
+        return;
+    }
+    m_configHashes = configHashes;
+    m_entityButtons = entityButtons;
+    m_rawEntities = rawEntities;
+    for (auto iter = m_entityButtons.constBegin(); iter != m_entityButtons.constEnd(); ++iter) {
+        addAvailableEntity(iter.key(), "remote", integrationId(), iter->friendlyName, iter->supportedFeatures,
+                           iter->customFeatures);
+        bindStates(iter.key());
+    }
+    for (auto iter = m_rawEntities.constBegin(); iter != m_rawEntities.constEnd(); ++iter) {
+        addAvailableEntity(iter.key(), "remote", integrationId(), iter->name, iter->supportedFeatures,
+                           iter->customFeatures);
     }
-    return "";
+    updateActivities();
+    qCInfo(m_logCategory) << "restored" << m_entityButtons.size() << "entities and" << m_rawEntities.size()
+                          << "unparsed entities from snapshot";
 }
 
-bool Mqtt::supportedFeature(const QString &buttonName, QStringList *supportedFeatures) {
-    QString feature = buttonNameToSupportedFeatures(buttonName);
-    if (feature != "") {
-        supportedFeatures->append(feature);
-        return true;
-    } else {
-        return false;
+void Mqtt::saveSnapshot() {
+    QDir().mkpath(QFileInfo(m_snapshotPath).absolutePath());
+    QSaveFile file(m_snapshotPath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qCWarning(m_logCategory) << "cannot write entity snapshot:" << file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_12);
+    out << SNAPSHOT_MAGIC << SNAPSHOT_VERSION << m_compiler.buttonAliases() << bridgeLayout() << m_configHashes
+        << static_cast<quint32>(m_entityButtons.size());
+    for (auto iter = m_entityButtons.constBegin(); iter != m_entityButtons.constEnd(); ++iter) {
+        out << iter.key() << iter->bridge << iter->friendlyName << iter->supportedFeatures << iter->customFeatures
+            << iter->contentHash << iter->stateEntityId << iter->stateTopics << iter->activation << iter->deactivation
+            << static_cast<quint32>(iter->buttons.size());
+        for (const Button &button : iter->buttons) {
+            out << m_buttonArena.name(button) << m_buttonArena.topic(button).name() << m_buttonArena.payload(button)
+                << button.minInterval << button.coalesce << button.ttl << button.qos << button.retain
+                << button.isTemplate;
+        }
+    }
+    out << static_cast<quint32>(m_rawEntities.size());
+    for (auto iter = m_rawEntities.constBegin(); iter != m_rawEntities.constEnd(); ++iter) {
+        out << iter.key() << iter->bridge << iter->name << iter->config << iter->supportedFeatures
+            << iter->customFeatures;
     }
+    if (!file.commit()) {
+        qCWarning(m_logCategory) << "cannot write entity snapshot:" << file.errorString();
+        return;
+    }
+    qCDebug(m_logCategory) << "saved entity snapshot:" << m_snapshotPath;
 }
 
 void Mqtt::connect() {
     setState(CONNECTING);
     initOnce();
+    materializeConfiguredEntities();
     qCInfo(m_logCategory) << "Connecting to MQTT";
-    m_mqtt->connectToHost();
+    for (Connection &connection : m_connections) {
+        // a connection which is up or still opening its session is kept, a new attempt would replace it
+        if (connection.client->state() == QMqttClient::Disconnected) {
+            connection.connector->start();
+        }
+    }
     setState(CONNECTED);
 }
 
@@ -338,137 +827,790 @@ void Mqtt::initOnce() {
     // initialize QMqttClient here because it does not work in constructor (connection never finishes)
     if (!m_initialized) {
         m_initialized = true;
-        qCInfo(m_logCategory) << "creating MQTT client";
-        m_mqtt = new QMqttClient(this);
-        QStringList hostname_port = m_ip.split(":");
-        QString     hostname = hostname_port[0];
-        int         port = (hostname_port.size() == 2) ? hostname_port[1].toInt() : 1883;
-        m_mqtt->setHostname(hostname);
-        m_mqtt->setPort(port);
-        QString macAddr;
-        QString clientId = "YIO-Remote-";
-        for (QNetworkInterface interface : QNetworkInterface::allInterfaces()) {
-            if (!(interface.flags() & QNetworkInterface::IsLoopBack)) {
-                macAddr = interface.hardwareAddress();
-                break;
+        // enumerating the interfaces is slow on the remote, the id only changes with the hardware
+        m_clientId = m_cache->value("client_id").toString();
+        if (m_clientId.isEmpty()) {
+            QString macAddr;
+            QString clientId = "YIO-Remote-";
+            for (QNetworkInterface interface : QNetworkInterface::allInterfaces()) {
+                if (!(interface.flags() & QNetworkInterface::IsLoopBack)) {
+                    macAddr = interface.hardwareAddress();
+                    break;
+                }
             }
+            macAddr.replace(":", "");
+            clientId.append(macAddr);
+            m_clientId = clientId;
+            m_cache->setValue("client_id", m_clientId);
         }
-        macAddr.replace(":", "");
-        clientId.append(macAddr);
-        m_mqtt->setClientId(clientId);
-        qCInfo(m_logCategory) << "MQTT Broker: " << hostname + ":" << port;
-        QObject::connect(m_mqtt, &QMqttClient::connected, this, [this]() {
-            qCInfo(m_logCategory) << "MQTT connected!";
-            m_mqttReconnectTimer->stop();
-            m_mqtt->subscribe(QMqttTopicFilter("mqtt_urc/config/devices"), 0);
-            m_mqtt->subscribe(QMqttTopicFilter("mqtt_urc/config/activities"), 0);
-            m_mqtt->subscribe(QMqttTopicFilter("mqtt_urc/config/current_activity"), 0);
-
-            QTimer *deviceRequestTimer = new QTimer(this);
-            deviceRequestTimer->setSingleShot(true);
-            QObject::connect(deviceRequestTimer, &QTimer::timeout, [=]() {
-                qint32 pubDeviceRequest =
-                    m_mqtt->publish(QMqttTopicName("mqtt_urc/config/request"), "{\"RequestConfig\":\"devices\"}");
-                qCInfo(m_logCategory) << "pubDeviceRequest id:" << pubDeviceRequest;
-                deviceRequestTimer->deleteLater();
-            });
 
-            QTimer *activityRequestTimer = new QTimer(this);
-            activityRequestTimer->setSingleShot(true);
-            QObject::connect(activityRequestTimer, &QTimer::timeout, [=]() {
-                qint32 pubActivitiesRequest =
-                    m_mqtt->publish(QMqttTopicName("mqtt_urc/config/request"), "{\"RequestConfig\":\"activities\"}");
-                qCInfo(m_logCategory) << "pubActivitiesRequest id:" << pubActivitiesRequest;
-                activityRequestTimer->deleteLater();
+        for (int i = 0; i < m_connections.size(); i++) {
+            initConnection(i);
+        }
+        for (int i = 0; i < m_bridges.size(); i++) {
+            const QString &prefix = m_bridges[i].prefix;
+            TopicRouter   *router = m_connections[m_bridges[i].connection].router.data();
+            addConfigRequest(i, prefix + "/config/devices", "{\"RequestConfig\":\"devices\"}");
+            addConfigRequest(i, prefix + "/config/activities", "{\"RequestConfig\":\"activities\"}");
+            addConfigRequest(i, prefix + "/config/current_activity", "{\"RequestConfig\":\"currentActivity\"}");
+            router->addRoute(prefix + "/config/devices",
+                             [this, i](const QByteArray &message, const QMqttTopicName &topic) {
+                                 configReceived(message, topic, "devices", i);
+                             });
+            router->addRoute(prefix + "/config/activities",
+                             [this, i](const QByteArray &message, const QMqttTopicName &topic) {
+                                 configReceived(message, topic, "activities", i);
+                             });
+            router->addRoute(prefix + "/config/current_activity",
+                             [this, i](const QByteArray &message, const QMqttTopicName &) {
+                                 currentActivityReceived(i, message);
+                             });
+        }
+        // on demand statistics, e.g. for a benchmark harness on the broker: "reset" starts a new measurement
+        m_connections[m_bridges[0].connection].router->addRoute(
+            m_bridges[0].prefix + "/stats/request", [this](const QByteArray &message, const QMqttTopicName &) {
+                publishStats();
+                if (message == "reset") {
+                    resetStats();
+                }
             });
+        if (m_statsInterval > 0) {
+            m_statsTimer = new QTimer(this);
+            m_statsTimer->setInterval(m_statsInterval * 1000);
+            QObject::connect(m_statsTimer, &QTimer::timeout, this, &Mqtt::publishStats);
+            m_statsTimer->start();
+        }
+    } else {
+        qCInfo(m_logCategory) << "already initialized";
+    }
+}
+
+void Mqtt::initConnection(int index) {
+    Connection &connection = m_connections[index];
+    qCInfo(m_logCategory) << "creating MQTT client for broker:" << connection.hostname << connection.port;
+    QMqttClient *client = new QMqttClient(this);
+    connection.client = client;
+    client->setHostname(connection.hostname);
+    client->setPort(connection.port);
+    client->setClientId(m_clientId);
+    client->setKeepAlive(m_keepAlive);
+    // with a persistent session the broker keeps the subscriptions while the remote sleeps or reconnects
+    client->setCleanSession(!m_persistentSession);
+    if (m_mqtt5) {
+        client->setProtocolVersion(QMqttClient::MQTT_5_0);
+        QMqttConnectionProperties properties;
+        // an MQTT 5 session ends with the connection unless it has an expiry interval
+        properties.setSessionExpiryInterval(m_persistentSession ? SESSION_EXPIRY_INTERVAL : 0);
+        // let the broker alias our state topics as well
+        properties.setMaximumTopicAlias(static_cast<quint16>(m_topicAliasLimit));
+        client->setConnectionProperties(properties);
+    }
+    // the client gets the socket of the first broker address which answers
+    connection.connector = new BrokerConnector(connection.hostname, connection.port, this);
+    QString cacheKey = QString("last_good/%1:%2").arg(connection.hostname).arg(connection.port);
+    QString lastGood = m_cache->value(cacheKey).toString();
+    int     separator = lastGood.lastIndexOf(':');
+    if (separator > 0) {
+        connection.connector->setLastGood(QHostAddress(lastGood.left(separator)), lastGood.mid(separator + 1).toInt());
+    }
+    connection.wakePingTimer = new QTimer(this);
+    connection.wakePingTimer->setSingleShot(true);
+    connection.wakePingTimer->setInterval(WAKE_PING_TIMEOUT);
+    connection.reconnectTimer = new QTimer(this);
+    connection.reconnectTimer->setSingleShot(true);
+    connection.ackTimer = new QTimer(this);
+    connection.ackTimer->setSingleShot(true);
+    connection.ackTimer->setInterval(ACK_TIMEOUT);
+    // every broker has its own queue, a slow or unreachable one doesn't hold back commands on the others
+    connection.publisher = new PublishScheduler(
+        [this, index](const QMqttTopicName &topic, const QByteArray &payload, quint8 qos, bool retain) {
+            return publish(&m_connections[index], topic, payload, qos, retain);
+        },
+        [this, index]() {
+            const Connection &connection = m_connections[index];
+            QIODevice        *transport = connection.client->transport();
+            return connection.inFlight.size() >= connection.receiveMaximum ||
+                   (transport != nullptr && transport->bytesToWrite() > PUBLISH_BACKLOG_LIMIT);
+        },
+        this);
+
+    QObject::connect(connection.connector, &BrokerConnector::connected, this,
+                     [this, index](QTcpSocket *socket) { transportConnected(index, socket); });
+    QObject::connect(connection.connector, &BrokerConnector::failed, this, [this, index]() {
+        qCWarning(m_logCategory) << "cannot reach MQTT broker" << m_connections[index].hostname;
+        if (state() != DISCONNECTED && !m_standby) {
+            scheduleReconnect(&m_connections[index]);
+        }
+    });
+    QObject::connect(client, &QMqttClient::connected, this, [this, index]() { connected(index); });
+    QObject::connect(client, &QMqttClient::disconnected, this, [this, index]() { disconnected(index); });
+    QObject::connect(connection.reconnectTimer, &QTimer::timeout, this, [this, index]() {
+        if (m_connections[index].client->state() != QMqttClient::Disconnected) {
+            return;
+        }
+        qCInfo(m_logCategory) << "retry connect to MQTT broker" << m_connections[index].hostname;
+        m_connections[index].connector->start();
+    });
+    QObject::connect(client, &QMqttClient::pingResponseReceived, this, [this, index]() {
+        if (m_connections[index].wakePingTimer->isActive()) {
+            qCDebug(m_logCategory) << "connection alive after wake up";
+            m_connections[index].wakePingTimer->stop();
+        }
+    });
+    QObject::connect(connection.wakePingTimer, &QTimer::timeout, this, [this, index]() {
+        qCWarning(m_logCategory) << "no ping response after wake up, reconnecting";
+        reconnectNow(&m_connections[index]);
+    });
+    QObject::connect(client, &QMqttClient::stateChanged, this, [this](QMqttClient::ClientState state) {
+        qCInfo(m_logCategory) << "MQTT state changed:" << state;
+    });
+    QObject::connect(client, &QMqttClient::errorChanged, this, [this](QMqttClient::ClientError error) {
+        qCCritical(m_logCategory) << "MQTT error changed:" << error;
+    });
+    QObject::connect(client, &QMqttClient::messageReceived, this,
+                     [this, index](const QByteArray &message, const QMqttTopicName &topic) {
+                         messageReceived(index, message, topic);
+                     });
+    QObject::connect(client, &QMqttClient::messageSent, this,
+                     [this, index](qint32 id) { acknowledged(&m_connections[index], id); });
+    QObject::connect(connection.ackTimer, &QTimer::timeout, this,
+                     [this, index]() { checkDeliveries(&m_connections[index]); });
+}
+
+void Mqtt::transportConnected(int index, QTcpSocket *socket) {
+    Connection &connection = m_connections[index];
+    if (state() == DISCONNECTED) {
+        socket->deleteLater();
+        return;
+    }
+    qCDebug(m_logCategory) << "TCP connected:" << connection.hostname << socket->peerAddress() << socket->peerPort();
+    socket->setParent(this);
+    connection.client->setTransport(socket, QMqttClient::AbstractSocket);
+    if (connection.socket != nullptr) {
+        connection.socket->deleteLater();
+    }
+    connection.socket = socket;
+    // the keep-alive can only be changed while the client is disconnected and is negotiated on connect
+    connection.client->setKeepAlive(m_standby ? m_standbyKeepAlive : m_keepAlive);
+    connection.client->connectToHost();
+}
+
+void Mqtt::connected(int index) {
+    Connection &connection = m_connections[index];
+    qCInfo(m_logCategory) << "MQTT connected:" << connection.hostname;
+    // tried first on the next connect, this skips the name lookup and discovery
+    if (connection.socket != nullptr) {
+        QHostAddress address = connection.socket->peerAddress();
+        quint16      port = connection.socket->peerPort();
+        connection.connector->setLastGood(address, port);
+        m_cache->setValue(QString("last_good/%1:%2").arg(connection.hostname).arg(connection.port),
+                          QString("%1:%2").arg(address.toString()).arg(port));
+    }
+    connection.reconnectTimer->stop();
+    connection.reconnectDelay = RECONNECT_DELAY_MIN;
+    connection.keepAlive = connection.client->keepAlive();
+    // topic aliases only live as long as the connection, the limits are announced by the broker in CONNACK
+    connection.topicAliases.clear();
+    connection.inFlight.clear();
+    if (m_mqtt5) {
+        const QMqttServerConnectionProperties &server = connection.client->serverConnectionProperties();
+        connection.topicAliasMaximum = qMin(server.maximumTopicAlias(), static_cast<quint16>(m_topicAliasLimit));
+        connection.receiveMaximum = qMax(server.maximumReceive(), static_cast<quint16>(1));
+        qCInfo(m_logCategory) << "MQTT 5 topic aliases:" << connection.topicAliasMaximum
+                              << "receive maximum:" << connection.receiveMaximum;
+    }
+    // commands issued while disconnected are replayed first
+    connection.publisher->setOnline(true);
+
+    // only request the entities of a bridge when it has none or they were only restored from the snapshot
+    for (auto iter = connection.configRequests.begin(); iter != connection.configRequests.end(); ++iter) {
+        const Bridge &bridge = m_bridges[iter->bridge];
+        iter->pending =
+            iter.key().endsWith("/current_activity") || !bridge.configValidated || !hasEntities(iter->bridge);
+        iter->attempts = 0;
+        // fallback in case a subscription is never acknowledged
+        if (iter->pending) {
+            iter->timer->start(CONFIG_REQUEST_TIMEOUT);
+        }
+    }
+
+    // all requests are pipelined as soon as the broker acknowledged the reply subscriptions
+    connection.configRequestsSent = false;
+    connection.configSubscriptions.clear();
+    QStringList filters = connection.configRequests.keys();
+    for (const ConfigRequest &request : connection.configRequests) {
+        if (!request.responseTopic.isEmpty()) {
+            filters.append(request.responseTopic);
+        }
+    }
+    for (const QString &filter : filters) {
+        QMqttSubscription *subscription = connection.client->subscribe(QMqttTopicFilter(filter), subscriptionQos());
+        if (subscription == nullptr) {
+            qCWarning(m_logCategory) << "cannot subscribe to" << filter;
+            continue;
+        }
+        connection.configSubscriptions.append(subscription);
+        QObject::connect(subscription, &QMqttSubscription::stateChanged, this, &Mqtt::sendPendingConfigRequests,
+                         Qt::UniqueConnection);
+    }
+    sendConfigRequests(index);
+    if (statesSubscribed()) {
+        subscribeStates(index);
+    }
+    if (index == m_bridges[0].connection) {
+        connection.client->subscribe(QMqttTopicFilter(m_bridges[0].prefix + "/stats/request"), subscriptionQos());
+    }
+}
+
+void Mqtt::disconnected(int index) {
+    Connection &connection = m_connections[index];
+    qCInfo(m_logCategory) << "MQTT disconnected:" << connection.hostname;
+    // outstanding requests are issued again after the next connect
+    for (const ConfigRequest &request : connection.configRequests) {
+        request.timer->stop();
+    }
+    connection.publisher->setOnline(false);
+    connection.wakePingTimer->stop();
+    connection.ackTimer->stop();
+    requeueDeliveries(&connection);
+    if (state() == DISCONNECTED) {
+        qCInfo(m_logCategory) << "not starting reconnect timer (integration state is DISCONNECTED)";
+    } else if (connection.reconnectNow) {
+        connection.reconnectNow = false;
+        connection.connector->start();
+    } else if (m_standby) {
+        qCInfo(m_logCategory) << "not starting reconnect timer (standby), reconnecting on wake up";
+    } else {
+        scheduleReconnect(&connection);
+    }
+}
+
+bool Mqtt::hasEntities(int bridge) const {
+    for (auto iter = m_rawEntities.constBegin(); iter != m_rawEntities.constEnd(); ++iter) {
+        if (iter->bridge == bridge) {
+            return true;
+        }
+    }
+    for (auto iter = m_entityButtons.constBegin(); iter != m_entityButtons.constEnd(); ++iter) {
+        if (iter->bridge == bridge) {
+            return true;
+        }
+    }
+    return false;
+}
 
-            QTimer *currentActivityRequestTimer = new QTimer(this);
-            currentActivityRequestTimer->setSingleShot(true);
-            QObject::connect(currentActivityRequestTimer, &QTimer::timeout, [=]() {
-                qint32 pubCurrentActivitiesRequest = m_mqtt->publish(QMqttTopicName("mqtt_urc/config/request"),
-                                                                     "{\"RequestConfig\":\"currentActivity\"}");
-                qCInfo(m_logCategory) << "pubCurrentActivitiesRequest id:" << pubCurrentActivitiesRequest;
-                currentActivityRequestTimer->deleteLater();
+void Mqtt::addConfigRequest(int bridge, const QString &replyTopic, const QByteArray &payload) {
+    int            connection = m_bridges[bridge].connection;
+    ConfigRequest &request = m_connections[connection].configRequests[replyTopic];
+    request.payload = payload;
+    request.bridge = bridge;
+    request.attempts = 0;
+    request.pending = false;
+    request.timer = new QTimer(this);
+    request.timer->setSingleShot(true);
+    if (m_mqtt5) {
+        // every request has a response topic of its own below the bridge prefix, so the topic tells which request
+        // a response answers; it is handled as if it had been published on the shared reply topic
+        request.responseTopic = QString("%1/config/response/%2/%3")
+                                    .arg(m_bridges[bridge].prefix, m_clientId, replyTopic.section('/', -1));
+        m_connections[connection].router->addRoute(
+            request.responseTopic, [this, connection, replyTopic](const QByteArray &message, const QMqttTopicName &) {
+                configReplyReceived(connection, replyTopic);
+                m_connections[connection].router->route(message, QMqttTopicName(replyTopic));
             });
+    }
+    QObject::connect(request.timer, &QTimer::timeout, this, [this, connection, replyTopic]() {
+        const ConfigRequest &request = m_connections[connection].configRequests[replyTopic];
+        if (!request.pending) {
+            return;
+        }
+        if (request.attempts >= CONFIG_REQUEST_MAX_ATTEMPTS) {
+            qCWarning(m_logCategory) << "no reply on" << replyTopic << "after" << request.attempts << "requests";
+            return;
+        }
+        qCInfo(m_logCategory) << "no reply on" << replyTopic << "yet, requesting again";
+        // the other requests don't wait for the subscriptions anymore either
+        m_connections[connection].configRequestsSent = true;
+        sendConfigRequest(connection, replyTopic);
+    });
+}
 
-            // only request mqtt entities when entity button map is empty
-            if (m_entityButtons->size() == 0) {
-                deviceRequestTimer->start(100);
-                activityRequestTimer->start(1500);
-                currentActivityRequestTimer->start(3000);
-            } else {
-                currentActivityRequestTimer->start(100);
-            }
-        });
-        m_mqttReconnectTimer->setSingleShot(true);
-        QObject::connect(m_mqttReconnectTimer, &QTimer::timeout, this, [=]() {
-            qCInfo(m_logCategory) << "retry connect to MQTT";
-            m_mqtt->connectToHost();
-        });
-        QObject::connect(m_mqtt, &QMqttClient::disconnected, this, [this]() {
-            qCInfo(m_logCategory) << "MQTT disconnected!";
-            if (state() != DISCONNECTED) {
-                qCInfo(m_logCategory) << "starting reconnect timer";
-                m_mqttReconnectTimer->start(10000);
-            } else {
-                qCInfo(m_logCategory) << "not starting reconnect timer (integration state is DISCONNECTED)";
-            }
-        });
-        QObject::connect(m_mqtt, &QMqttClient::stateChanged, this, [this](QMqttClient::ClientState state) {
-            qCInfo(m_logCategory) << "MQTT state changed:" << state;
-        });
-        QObject::connect(m_mqtt, &QMqttClient::errorChanged, this, [this](QMqttClient::ClientError error) {
-            qCCritical(m_logCategory) << "MQTT error changed:" << error;
-        });
-        QObject::connect(m_mqtt, &QMqttClient::messageReceived, this, &Mqtt::messageReceived);
+void Mqtt::sendPendingConfigRequests() {
+    for (int i = 0; i < m_connections.size(); i++) {
+        sendConfigRequests(i);
+    }
+}
+
+void Mqtt::sendConfigRequests(int index) {
+    Connection &connection = m_connections[index];
+    if (connection.configRequestsSent || connection.client->state() != QMqttClient::Connected) {
+        return;
+    }
+    // a rejected subscription doesn't block the requests, the reply may still arrive on another subscription
+    for (const QPointer<QMqttSubscription> &subscription : connection.configSubscriptions) {
+        if (!subscription.isNull() && subscription->state() == QMqttSubscription::SubscriptionPending) {
+            return;
+        }
+        if (!subscription.isNull() && subscription->state() == QMqttSubscription::Error) {
+            qCWarning(m_logCategory) << "subscription rejected:" << subscription->topic().filter();
+        }
+    }
+    connection.configRequestsSent = true;
+    for (auto iter = connection.configRequests.constBegin(); iter != connection.configRequests.constEnd(); ++iter) {
+        if (iter->pending) {
+            sendConfigRequest(index, iter.key());
+        }
+    }
+}
+
+void Mqtt::sendConfigRequest(int index, const QString &replyTopic) {
+    Connection    &connection = m_connections[index];
+    ConfigRequest &request = connection.configRequests[replyTopic];
+    const Bridge  &bridge = m_bridges[request.bridge];
+    QMqttTopicName    topic(bridge.prefix + "/config/request");
+    qint32            id;
+    if (m_mqtt5) {
+        // the reply can be sent to this client only, on the response topic of this request
+        QMqttPublishProperties properties;
+        properties.setResponseTopic(request.responseTopic);
+        properties.setCorrelationData(replyTopic.toUtf8());
+        properties.setUserProperties(QMqttUserProperties() << QMqttStringPair("client_id", m_clientId));
+        properties.setPayloadFormatIndicator(QMqtt::PayloadFormatIndicator::UTF8Encoded);
+        id = connection.client->publish(topic, properties, request.payload);
     } else {
-        qCInfo(m_logCategory) << "already initialized";
+        id = connection.client->publish(topic, request.payload);
+    }
+    qCInfo(m_logCategory) << "config request" << request.payload << "on" << topic.name() << "id:" << id;
+    // back off exponentially as long as the bridge does not answer
+    request.timer->start(CONFIG_REQUEST_TIMEOUT << request.attempts);
+    request.attempts++;
+}
+
+void Mqtt::configReplyReceived(int connection, const QString &replyTopic) {
+    QMap<QString, ConfigRequest> &requests = m_connections[connection].configRequests;
+    auto                          request = requests.find(replyTopic);
+    if (request != requests.end() && request->pending) {
+        qCDebug(m_logCategory) << "config reply on" << replyTopic << "after" << request->attempts << "requests";
+        request->pending = false;
+        request->timer->stop();
+    }
+}
+
+qint32 Mqtt::publish(Connection *connection, const QMqttTopicName &topic, const QByteArray &payload, quint8 qos,
+                    bool retain) {
+    qint32 id;
+    if (m_mqtt5) {
+        QMqttPublishProperties properties;
+        quint16                alias = topicAlias(connection, topic);
+        if (alias > 0) {
+            properties.setTopicAlias(alias);
+        }
+        properties.setPayloadFormatIndicator(QMqtt::PayloadFormatIndicator::UTF8Encoded);
+        id = connection->client->publish(topic, properties, payload, qos, retain);
+    } else {
+        id = connection->client->publish(topic, payload, qos, retain);
+    }
+    m_metrics.increment(Metrics::Publishes);
+    // QoS 1/2 publishes count against the broker's receive maximum until they are acknowledged
+    if (qos > 0 && id > 0) {
+        qint64     now = m_metrics.now();
+        QByteArray copy(payload.constData(), payload.size());  // the payload may be a raw view into the button arena
+        connection->inFlight.insert(id, {topic, copy, qos, retain, now, now, 1});
+        if (!connection->ackTimer->isActive()) {
+            connection->ackTimer->start();
+        }
+    }
+    return id;
+}
+
+void Mqtt::acknowledged(Connection *connection, qint32 id) {
+    // messageSent is emitted on PUBACK for QoS 1 and on PUBCOMP for QoS 2
+    auto delivery = connection->inFlight.find(id);
+    if (delivery == connection->inFlight.end()) {
+        return;
+    }
+    m_metrics.record(Metrics::Ack, delivery->firstSent);
+    connection->inFlight.erase(delivery);
+    if (connection->inFlight.isEmpty()) {
+        connection->ackTimer->stop();
     }
 }
 
+void Mqtt::checkDeliveries(Connection *connection) {
+    qint64            timeout = m_metrics.now() - static_cast<qint64>(ACK_TIMEOUT) * 1000000;
+    QVector<Delivery> retransmits;
+    for (auto delivery = connection->inFlight.begin(); delivery != connection->inFlight.end();) {
+        if (delivery->lastSent > timeout) {
+            ++delivery;
+            continue;
+        }
+        if (delivery->attempts >= ACK_MAX_ATTEMPTS) {
+            qCWarning(m_logCategory) << "no acknowledgement for publish on" << delivery->topic.name() << "after"
+                                     << delivery->attempts << "attempts, giving up";
+            m_metrics.increment(Metrics::Undelivered);
+        } else {
+            retransmits.append(*delivery);
+        }
+        delivery = connection->inFlight.erase(delivery);
+    }
+    // the client has no API to resend with the DUP flag, the publish is sent again with a new id
+    for (const Delivery &delivery : retransmits) {
+        qCInfo(m_logCategory) << "no acknowledgement for publish on" << delivery.topic.name() << ", sending again";
+        m_metrics.increment(Metrics::Retransmits);
+        qint32 id = publish(connection, delivery.topic, delivery.payload, delivery.qos, delivery.retain);
+        auto   sent = connection->inFlight.find(id);
+        if (sent != connection->inFlight.end()) {
+            sent->firstSent = delivery.firstSent;
+            sent->attempts = delivery.attempts + 1;
+        }
+    }
+    if (!connection->inFlight.isEmpty() && !connection->ackTimer->isActive()) {
+        connection->ackTimer->start();
+    }
+}
+
+void Mqtt::requeueDeliveries(Connection *connection) {
+    // unacknowledged publishes are sent again after the reconnect in their original order, not after disconnect()
+    QList<Delivery> deliveries = connection->inFlight.values();
+    connection->inFlight.clear();
+    if (state() == DISCONNECTED) {
+        return;
+    }
+    std::sort(deliveries.begin(), deliveries.end(),
+              [](const Delivery &a, const Delivery &b) { return a.firstSent < b.firstSent; });
+    for (const Delivery &delivery : deliveries) {
+        connection->publisher->publish(delivery.topic, delivery.payload, 0, false, COMMAND_TTL, delivery.qos,
+                                       delivery.retain);
+    }
+}
+
+quint16 Mqtt::topicAlias(Connection *connection, const QMqttTopicName &topic) {
+    // the first publish on a topic sends the name together with the alias, following publishes the alias only
+    auto alias = connection->topicAliases.constFind(topic.name());
+    if (alias != connection->topicAliases.constEnd()) {
+        return *alias;
+    }
+    if (connection->topicAliases.size() >= connection->topicAliasMaximum) {
+        return 0;
+    }
+    quint16 next = static_cast<quint16>(connection->topicAliases.size() + 1);
+    connection->topicAliases.insert(topic.name(), next);
+    return next;
+}
+
+QVariantMap Mqtt::stats() const {
+    QVariantMap stats = m_metrics.snapshot();
+    int         queued = 0, dropped = 0, expired = 0, inFlight = 0;
+    for (const Connection &connection : m_connections) {
+        if (connection.publisher != nullptr) {
+            queued += connection.publisher->queued();
+            dropped += connection.publisher->dropped();
+            expired += connection.publisher->expired();
+        }
+        inFlight += connection.inFlight.size();
+    }
+    stats.insert("queued", queued);
+    stats.insert("dropped", dropped);
+    stats.insert("expired", expired);
+    stats.insert("in_flight", inFlight);
+    int buttons = 0;
+    for (auto iter = m_entityButtons.constBegin(); iter != m_entityButtons.constEnd(); ++iter) {
+        buttons += iter->buttons.size();
+    }
+    stats.insert("entities", m_entityButtons.size());
+    stats.insert("raw_entities", m_rawEntities.size());
+    stats.insert("buttons", buttons);
+    stats.insert("button_bytes", m_buttonArena.size());
+    stats.insert("button_topics", m_buttonArena.topicCount());
+    stats.insert("connections", m_connections.size());
+    stats.insert("bridges", m_bridges.size());
+    qint64 memory = Metrics::currentMemory();
+    stats.insert("memory", memory);
+    stats.insert("peak_memory", qMax(memory, m_metrics.peakMemory()));
+    return stats;
+}
+
+void Mqtt::resetStats() {
+    m_metrics.reset();
+}
+
+void Mqtt::publishStats() {
+    const Bridge &bridge = m_bridges[0];
+    QMqttClient  *client = m_connections[bridge.connection].client;
+    if (client->state() != QMqttClient::Connected || m_standby) {
+        return;
+    }
+    client->publish(QMqttTopicName(QString("%1/stats/%2").arg(bridge.prefix, m_clientId)),
+                    QJsonDocument::fromVariant(stats()).toJson(QJsonDocument::Compact));
+}
+
+void Mqtt::scheduleReconnect(Connection *connection) {
+    // exponential backoff with +-10% jitter, so several remotes don't hit a restarting broker at the same time
+    int jitter = QRandomGenerator::global()->bounded(connection->reconnectDelay / 5 + 1);
+    int delay = connection->reconnectDelay - connection->reconnectDelay / 10 + jitter;
+    qCInfo(m_logCategory) << "starting reconnect timer for" << connection->hostname << ":" << delay << "ms";
+    connection->reconnectTimer->start(delay);
+    connection->reconnectDelay = qMin(connection->reconnectDelay * 2, RECONNECT_DELAY_MAX);
+}
+
 void Mqtt::disconnect() {
     setState(DISCONNECTED);
+    invalidateEntityHandles();
     qCInfo(m_logCategory) << "Disconnecting from MQTT";
-    m_mqtt->disconnectFromHost();
+    for (Connection &connection : m_connections) {
+        if (connection.client == nullptr) {
+            continue;
+        }
+        connection.reconnectTimer->stop();
+        connection.connector->abort();
+        connection.publisher->clear();
+        connection.client->disconnectFromHost();
+    }
+}
+
+void Mqtt::reconnectNow(Connection *connection) {
+    // the disconnected handler connects again right away, keeping the session
+    connection->reconnectNow = true;
+    connection->client->disconnectFromHost();
 }
 
-void Mqtt::enterStandby() { qCDebug(m_logCategory) << "Entering standby"; }
+void Mqtt::enterStandby() {
+    qCDebug(m_logCategory) << "Entering standby";
+    m_standby = true;
+    for (int i = 0; i < m_connections.size(); i++) {
+        Connection &connection = m_connections[i];
+        if (connection.client == nullptr || connection.client->state() != QMqttClient::Connected) {
+            continue;
+        }
+        if (m_standbyUnsubscribeStates) {
+            unsubscribeStates(i);
+        }
+        // the keep-alive is negotiated on connect, a longer one needs a new connection, see transportConnected()
+        if (m_standbyKeepAlive != connection.keepAlive) {
+            qCInfo(m_logCategory) << "reconnecting with standby keep-alive" << m_standbyKeepAlive;
+            reconnectNow(&connection);
+        }
+    }
+}
 
-void Mqtt::leaveStandby() { qCDebug(m_logCategory) << "Leaving standby"; }
+void Mqtt::leaveStandby() {
+    qCDebug(m_logCategory) << "Leaving standby";
+    m_standby = false;
+    if (!m_initialized || state() == DISCONNECTED) {
+        return;
+    }
+    for (int i = 0; i < m_connections.size(); i++) {
+        Connection &connection = m_connections[i];
+        // a standby keep-alive is kept until the next reconnect, waking up must not wait for a new connection
+        if (connection.client->state() == QMqttClient::Disconnected) {
+            // don't wait for the reconnect timer, the first presses after wake up are queued until connected
+            qCInfo(m_logCategory) << "reconnecting after standby:" << connection.hostname;
+            connection.reconnectTimer->stop();
+            connection.reconnectDelay = RECONNECT_DELAY_MIN;
+            connection.connector->start();
+        } else if (connection.client->state() == QMqttClient::Connected) {
+            // the connection may have died silently during standby: check it now instead of at the next keep-alive
+            connection.client->requestPing();
+            connection.wakePingTimer->start();
+            // fast path resume: the broker sends the retained states and only the current activity is requested
+            if (m_standbyUnsubscribeStates) {
+                subscribeStates(i);
+            }
+            for (int bridge = 0; bridge < m_bridges.size(); bridge++) {
+                if (m_bridges[bridge].connection != i) {
+                    continue;
+                }
+                QString        replyTopic = m_bridges[bridge].prefix + "/config/current_activity";
+                ConfigRequest &request = connection.configRequests[replyTopic];
+                request.pending = true;
+                request.attempts = 0;
+                sendConfigRequest(i, replyTopic);
+            }
+        }
+    }
+}
 
 void Mqtt::sendCommand(const QString &type, const QString &entity_id, int command, const QVariant &param) {
-    if (m_mqtt->state() != QMqttClient::Connected) {
-        qCWarning(m_logCategory) << "MQTT client not connected";
+    Q_UNUSED(type)
+    qint64 start = m_metrics.now();
+    if (!m_initialized) {
+        qCWarning(m_logCategory) << "MQTT client not initialized";
+        return;
+    }
+
+    auto entityButtons = m_entityButtons.find(entity_id);
+    if (entityButtons == m_entityButtons.end() && materializeEntity(entity_id)) {
+        entityButtons = m_entityButtons.find(entity_id);
+    }
+    if (entityButtons == m_entityButtons.end()) {
+        qCWarning(m_logCategory) << "m_entityButtons does not contain id:" << entity_id;
         return;
     }
 
-    if (param.type() == QVariant::String && param.toString() == "custom_command") {
-        Button button = m_entityButtons->value(entity_id)->at(command);
-        qCInfo(m_logCategory) << "sending custom command button" << button.name << button.topic << button.payload;
-        m_mqtt->publish(QMqttTopicName(button.topic), button.payload.toUtf8());
+    // Payloads of buttons with the "template" option are filled from the parameter: a feature command passes it as
+    // ${value} or, if it is a map, by key. A custom command is either the plain string "custom_command" without a
+    // value, or a map with the key "custom_command" which selects the button by index (command) or by its name in
+    // "button", the other keys fill the template. The map is the only way to pass a value to a button without a
+    // feature, e.g. VOLUME_SET.
+    const Button *button = nullptr;
+    QVariant      value = param;
+    bool          customMap = param.type() == QVariant::Map && param.toMap().contains("custom_command");
+    if (customMap || (param.type() == QVariant::String && param.toString() == "custom_command")) {
+        QString buttonName = customMap ? param.toMap().value("button").toString() : QString();
+        if (!buttonName.isEmpty()) {
+            button = EntityCompiler::findButton(m_buttonArena, *entityButtons, buttonName);
+        } else if (command >= 0 && command < entityButtons->buttons.size()) {
+            button = &entityButtons->buttons.at(command);
+        }
+        if (!customMap) {
+            value.clear();
+        }
     } else {
-        qCInfo(m_logCategory) << "sending command" << entity_id << command << param;
-        EntityInterface *entity = m_entities->getEntityInterface(entity_id);
-        QString          commandName = entity->getCommandName(command);
-        QString          buttonName = supportedFeatureToButtonName(commandName);
-        qCInfo(m_logCategory) << "command name" << commandName;
-        qCInfo(m_logCategory) << "button name" << buttonName;
-
-        if (!m_entityButtons->contains(entity_id)) {
-            qCWarning(m_logCategory) << "m_entityButtons does not contain id:" << entity_id;
-            return;
+        button = m_compiler.resolveCommand(&entityButtons.value(), command, [this, &entity_id, command]() {
+            EntityInterface *entity = entityInterface(entity_id);
+            return entity != nullptr ? entity->getCommandName(command) : QString();
+        });
+    }
+
+    if (button == nullptr) {
+        qCWarning(m_logCategory) << "no button for command" << command << "of entity" << entity_id;
+        return;
+    }
+    // the first two buttons of an activity switch it on and off, with steps they are run here instead of the bridge
+    int index = static_cast<int>(button - entityButtons->buttons.constData());
+    if (index < 2 && !(index == 0 ? entityButtons->activation : entityButtons->deactivation).isEmpty()) {
+        runActivityMacro(entity_id, index == 0);
+    } else {
+        publishButton(*entityButtons, *button, value);
+    }
+    m_metrics.record(Metrics::Command, start);
+}
+
+bool Mqtt::publishButton(const EntityButtons &entity, const Button &button, const QVariant &value) {
+    PublishScheduler     *publisher = m_connections[m_bridges[entity.bridge].connection].publisher;
+    const QMqttTopicName &topic = m_buttonArena.topic(button);
+    QByteArray            payload;
+    if (!m_buttonArena.render(button, value, &payload)) {
+        qCWarning(m_logCategory) << "not sent, no value for the payload template of button"
+                                 << m_buttonArena.name(button) << m_buttonArena.payload(button);
+        return false;
+    }
+    qCDebug(m_logCategory) << "sending command button" << m_buttonArena.name(button) << topic.name() << payload;
+    if (!publisher->isOnline()) {
+        qCDebug(m_logCategory) << "MQTT client not connected, command queued";
+    }
+    if (!publisher->publish(topic, payload, button.minInterval, button.coalesce, button.ttl, button.qos,
+                            button.retain)) {
+        qCWarning(m_logCategory) << "publish queue full, dropped the oldest command";
+    }
+    return true;
+}
+
+void Mqtt::runActivityMacro(const QString &activityId, bool activate) {
+    const EntityButtons         &activity = m_entityButtons[activityId];
+    QVector<ActivityMacro::Step> steps = activate ? activity.activation : activity.deactivation;
+    int                          bridge = activity.bridge;
+    qint64                       start = m_metrics.now();
+    qCInfo(m_logCategory) << (activate ? "activating" : "deactivating") << activityId;
+
+    // switching the same activity again replaces the running macro
+    QPointer<ActivityMacro> &running = m_macros[activityId];
+    if (!running.isNull()) {
+        running->cancel();
+        running->deleteLater();
+    }
+    auto executor = [this, bridge, activityId](const ActivityMacro::Step &step) {
+        return runMacroStep(bridge, activityId, step);
+    };
+    ActivityMacro *macro = new ActivityMacro(steps, executor, this);
+    running = macro;
+    // the new activity is current right away, so deactivating the previous one keeps the devices both use
+    if (activate) {
+        m_bridges[bridge].currentActivity = activityId;
+        m_currentActivityChanged = true;
+        if (!m_stateTimer->isActive()) {
+            m_stateTimer->start();
         }
-        QList<Button> *buttons = m_entityButtons->value(entity_id);
-        qCInfo(m_logCategory) << "entity buttons:" << buttons->size();
+    }
 
-        for (auto const &button : *buttons) {
-            if (button.name.toUpper() == buttonName) {
-                qCInfo(m_logCategory) << "sending command button" << button.name << button.topic << button.payload;
-                m_mqtt->publish(QMqttTopicName(button.topic), button.payload.toUtf8());
-                break;
-            } else {
-                // qCDebug(m_logCategory) << button.name.toUpper() << "!=" << buttonName;
+    auto stepFinished = [this, bridge, activityId, steps](int index, int status) {
+        static const char *STATUS_NAMES[] = {"done", "skipped", "failed"};
+        const ActivityMacro::Step &step = steps.at(index);
+        qCInfo(m_logCategory) << activityId << "step" << index << step.device << step.button << STATUS_NAMES[status];
+        // progress for the bridge or a dashboard
+        QVariantMap progress({{"activity", activityId},
+                              {"step", index},
+                              {"steps", steps.size()},
+                              {"device", step.device},
+                              {"button", step.button},
+                              {"status", STATUS_NAMES[status]}});
+        m_connections[m_bridges[bridge].connection].publisher->publish(
+            QMqttTopicName(m_bridges[bridge].prefix + "/activity/progress"),
+            QJsonDocument::fromVariant(progress).toJson(QJsonDocument::Compact));
+    };
+    auto finished = [this, bridge, activityId, activate, start, macro](bool complete) {
+        qCInfo(m_logCategory) << activityId << (activate ? "activated" : "deactivated")
+                              << (complete ? "" : "with failed steps");
+        m_metrics.record(Metrics::Activity, start);
+        if (!activate && m_bridges[bridge].currentActivity == activityId) {
+            m_bridges[bridge].currentActivity.clear();
+            m_currentActivityChanged = true;
+            if (!m_stateTimer->isActive()) {
+                m_stateTimer->start();
             }
         }
+        m_macros.remove(activityId);
+        macro->deleteLater();
+    };
+    QObject::connect(macro, &ActivityMacro::stepFinished, this, stepFinished);
+    QObject::connect(macro, &ActivityMacro::finished, this, finished);
+    macro->start();
+}
+
+ActivityMacro::Status Mqtt::runMacroStep(int bridge, const QString &activityId, const ActivityMacro::Step &step) {
+    if (step.button.isEmpty()) {
+        return ActivityMacro::Done;
+    }
+    auto device = m_entityButtons.find(step.device);
+    if (device == m_entityButtons.end() && materializeEntity(step.device)) {
+        device = m_entityButtons.find(step.device);
+    }
+    if (device == m_entityButtons.end()) {
+        qCWarning(m_logCategory) << "unknown device" << step.device << "in activity" << activityId;
+        return ActivityMacro::Failed;
+    }
+
+    // devices already in the target state are not switched, neither are devices the current activity still uses.
+    // Only a state reported on a state topic counts: a device without feedback may have been switched by other means.
+    if (step.button == "POWERON" || step.button == "POWEROFF") {
+        bool           on = step.button == "POWERON";
+        auto           power = m_powerStates.constFind(step.device);
+        const QString &currentActivity = m_bridges[bridge].currentActivity;
+        if (power != m_powerStates.constEnd() && *power == on) {
+            return ActivityMacro::Skipped;
+        }
+        if (!on && currentActivity != activityId && usedByActivity(currentActivity, step.device)) {
+            return ActivityMacro::Skipped;
+        }
+    }
+
+    const Button *button = EntityCompiler::findButton(m_buttonArena, *device, step.button);
+    if (button != nullptr) {
+        return publishButton(*device, *button, QVariant()) ? ActivityMacro::Done : ActivityMacro::Failed;
+    }
+    qCWarning(m_logCategory) << "unknown button" << step.button << "of" << step.device << "in activity" << activityId;
+    return ActivityMacro::Failed;
+}
+
+bool Mqtt::usedByActivity(const QString &activityId, const QString &deviceId) const {
+    auto activity = m_entityButtons.constFind(activityId);
+    if (activity == m_entityButtons.constEnd()) {
+        return false;
+    }
+    for (const ActivityMacro::Step &step : activity->activation) {
+        if (step.device == deviceId) {
+            return true;
+        }
     }
+    return false;
 }
@@ -25,14 +25,27 @@
 #pragma once
 
 #include <QtMqtt/qmqttclient.h>
+#include <QtMqtt/qmqttconnectionproperties.h>
+#include <QtMqtt/qmqttmessage.h>
+#include <QtMqtt/qmqttpublishproperties.h>
+#include <QtMqtt/qmqttsubscription.h>
 
 #include <QColor>
+#include <QFuture>
+#include <QHash>
 #include <QLoggingCategory>
+#include <QMap>
 #include <QObject>
+#include <QPair>
+#include <QPointer>
+#include <QSet>
+#include <QSettings>
+#include <QSharedPointer>
 #include <QString>
 #include <QThread>
 #include <QTimer>
 #include <QVariant>
+#include <QVector>
 
 #include "yio-interface/configinterface.h"
 #include "yio-interface/entities/entitiesinterface.h"
@@ -43,6 +56,14 @@
 #include "yio-plugin/integration.h"
 #include "yio-plugin/plugin.h"
 
+#include "activitymacro.h"
+#include "brokerconnector.h"
+#include "buttonarena.h"
+#include "entitycompiler.h"
+#include "metrics.h"
+#include "publishscheduler.h"
+#include "topicrouter.h"
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 //// MQTT FACTORY
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -68,21 +89,52 @@ class MqttPlugin : public Plugin {
 //// MQTT CLASS
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// Compiled entity/button model persisted between runs, bump the version whenever the layout changes
+const quint32 SNAPSHOT_MAGIC = 0x594D5153;  // "YMQS"
+const quint32 SNAPSHOT_VERSION = 13;
+
+// A config request is repeated with doubled timeout until the bridge answers
+const int CONFIG_REQUEST_TIMEOUT = 2000;
+const int CONFIG_REQUEST_MAX_ATTEMPTS = 5;
+
+// Publishes are queued instead of written while more than this is waiting in the socket
+const qint64 PUBLISH_BACKLOG_LIMIT = 4096;
+
+// A QoS 1/2 publish is sent again if the broker didn't acknowledge it within this time, at most this many times
+const int ACK_TIMEOUT = 3000;
+const int ACK_MAX_ATTEMPTS = 3;
+
+// Reconnect backoff
+const int RECONNECT_DELAY_MIN = 1000;
+const int RECONNECT_DELAY_MAX = 60000;
+// After wake up the connection is dropped if the broker doesn't answer a ping within this time
+const int WAKE_PING_TIMEOUT = 2000;
+
+// MQTT 5: the broker keeps a persistent session this long after the connection is closed (s)
+const quint32 SESSION_EXPIRY_INTERVAL = 7 * 24 * 3600;
+
+// State feedback: received states are applied at most once per entity and attribute within this interval (one frame)
+const int STATE_UPDATE_INTERVAL = 16;
+
 class Mqtt : public Integration {
     Q_OBJECT
 
  public:
     Mqtt(const QVariantMap& config, EntitiesInterface* entities, NotificationsInterface* notifications,
          YioAPIInterface* api, ConfigInterface* configObj, Plugin* plugin);
+    ~Mqtt() override;
 
     void sendCommand(const QString& type, const QString& entityId, int command, const QVariant& param) override;
 
-    struct Button {
-        Button(QString name, QString topic, QString payload) : name(name), topic(topic), payload(payload) {}
-        QString name;
-        QString topic;
-        QString payload;
-    };
+    // latency percentiles (µs), counters and memory (kB) since the integration was created or the stats were reset
+    Q_INVOKABLE QVariantMap stats() const;
+    Q_INVOKABLE void        resetStats();
+
+    // name, topic and payload are stored in m_buttonArena
+    typedef ButtonArena::Button Button;
+
+    // buttons of one entity, compiled at config ingest
+    typedef EntityCompiler::EntityButtons EntityButtons;
 
  public slots:  // NOLINT open issue: https://github.com/cpplint/cpplint/pull/99
     void connect() override;
@@ -90,21 +142,216 @@ class Mqtt : public Integration {
     void enterStandby() override;
     void leaveStandby() override;
 
-    void messageReceived(const QByteArray& message, const QMqttTopicName& topic);
+    void messageReceived(int connection, const QByteArray& message, const QMqttTopicName& topic);
 
  private:
+    // Bridges on different brokers may use the same prefix, their config topics are told apart by the bridge index.
+    typedef QPair<int, QString> BridgeTopic;
+
+    // A QoS 1/2 publish waiting for its acknowledgement.
+    struct Delivery {
+        QMqttTopicName topic;
+        QByteArray     payload;
+        quint8         qos;
+        bool           retain;
+        qint64         firstSent;  // ns
+        qint64         lastSent;   // ns
+        int            attempts;
+    };
+
+    struct ConfigRequest {
+        QByteArray payload;
+        int        bridge = 0;
+        QString    responseTopic;    // MQTT 5: the reply addressed to this client only
+        QTimer*    timer = nullptr;  // reply timeout
+        int        attempts = 0;
+        bool       pending = false;
+    };
+
+    // One broker connection, shared by the bridges on that broker. Every connection has its own publish queue, so a
+    // slow or unreachable broker doesn't hold back commands for the others.
+    struct Connection {
+        QString                            hostname;
+        int                                port = 1883;
+        QMqttClient*                       client = nullptr;
+        BrokerConnector*                   connector = nullptr;  // opens the transport of the client
+        QTcpSocket*                        socket = nullptr;     // current transport
+        PublishScheduler*                  publisher = nullptr;
+        QTimer*                            reconnectTimer = nullptr;
+        int                                reconnectDelay = RECONNECT_DELAY_MIN;
+        bool                               reconnectNow = false;
+        int                                keepAlive = 0;  // s, negotiated on the current connection
+        QTimer*                            wakePingTimer = nullptr;
+        QTimer*                            ackTimer = nullptr;
+        QHash<qint32, Delivery>            inFlight;  // message id -> unacknowledged QoS 1/2 publish
+        QSharedPointer<TopicRouter>        router;    // handlers of the messages received on this connection
+        QMap<QString, ConfigRequest>       configRequests;  // reply topic -> request on <prefix>/config/request
+        QList<QPointer<QMqttSubscription>> configSubscriptions;
+        bool                               configRequestsSent = false;
+
+        // MQTT 5
+        quint16                 topicAliasMaximum = 0;  // number of aliases usable on the current connection
+        QHash<QString, quint16> topicAliases;           // topic -> alias, valid for the current connection only
+        quint16                 receiveMaximum = 0xFFFF;  // QoS 1/2 publishes the broker accepts unacknowledged
+    };
+
+    // A bridge publishes its config and takes the activity commands below its topic prefix.
+    // The entity ids of a named bridge are namespaced with its name.
+    struct Bridge {
+        QString name;
+        QString prefix;                   // mqtt_urc by default
+        int     connection = 0;           // index in m_connections
+        bool    configValidated = false;  // a config was received in this run, not only restored from the snapshot
+        QString currentActivity;
+    };
+
+    // one device or activity of a config message, compiled on the thread pool
+    typedef EntityCompiler::CompileJob CompileJob;
+
+    // An entity of the catalog which is not compiled yet.
+    struct RawEntity {
+        QString     name;
+        QByteArray  config;  // raw JSON of the device or activity
+        int         bridge;
+        QStringList supportedFeatures;
+        QStringList customFeatures;
+    };
+
+    // A config message being compiled, applied to the entities in use when all its jobs are done.
+    struct ConfigCompilation {
+        QString             topic;
+        QString             prefix;  // MQTT_DEVICE. or MQTT_ACTIVITY.
+        int                 bridge;
+        quint32             generation;  // an outdated compilation of the same topic is discarded
+        QByteArray          message;     // the jobs are views into the message
+        QByteArray          messageHash;
+        qint64              start;
+        QVector<CompileJob> jobs;
+    };
+
+    struct ActivityHandle {
+        QString          entityId;
+        EntityInterface* entity;
+        int              bridge;
+    };
+
+    struct StateBinding {
+        QString entityId;  // entity the state topic is configured for
+        QString targetId;  // entity the state is applied to
+        int     attribute;
+        int     connection;  // the state topic is subscribed on this connection
+    };
+
     QString                        m_ip;
-    QMqttClient*                   m_mqtt;
+    QVector<Connection>            m_connections;
+    QVector<Bridge>                m_bridges;
     bool                           m_initialized;
-    QMap<QString, QList<Button>*>* m_entityButtons;
-    QMap<QString, QString>*        m_buttonFeatureMap;
-    QTimer*                        m_mqttReconnectTimer;
-    void                           handleDevices(const QVariantMap& map);
-    void                           handleActivities(const QVariantMap& map);
+    EntityCompiler                 m_compiler;
+    QHash<QString, EntityButtons>  m_entityButtons;
+    ButtonArena                    m_buttonArena;
+    QHash<BridgeTopic, QByteArray> m_configHashes;  // config topic -> hash of the last applied config message
+    QHash<BridgeTopic, quint32>    m_configGenerations;  // config topic -> generation of the latest compilation
+    QList<QFuture<void>>           m_compilations;       // running config compilations
+
+    // lazy entities
+    bool                       m_lazyEntities;
+    QHash<QString, RawEntity>  m_rawEntities;  // entity id -> config, until the entity is used
+    QHash<BridgeTopic, QByteArray> m_rawMessages;  // config topic -> message the raw entities point into
+    QString                        m_clientId;
+
+    // standby
+    bool m_standby;
+    int  m_keepAlive;         // s
+    int  m_standbyKeepAlive;  // s
+    bool m_standbyUnsubscribeStates;
+    bool m_persistentSession;
+
+    // MQTT 5
+    bool m_mqtt5;
+    int  m_topicAliasLimit;  // configured number of topic aliases
+
+    // instrumentation
+    Metrics m_metrics;
+    qint64  m_pendingStatesSince;  // receive time of the oldest state not applied yet, -1: none
+    int     m_statsInterval;       // s, 0: no stats publishing
+    QTimer* m_statsTimer;
+
+    QString                        m_snapshotPath;
+    QSettings*                     m_cache;  // client id and last good broker addresses
+    QTimer*                        m_snapshotTimer;
+
+    // state feedback
+    QHash<QString, QVector<StateBinding>> m_stateBindings;  // state topic filter -> bindings
+    QHash<QString, QHash<int, QVariant>>  m_pendingStates;  // entity id -> attribute -> latest value
+    QTimer*                               m_stateTimer;
+
+    // activity macros
+    QHash<QString, QPointer<ActivityMacro>> m_macros;       // activity id -> running macro
+    QHash<QString, bool>                    m_powerStates;  // device entity id -> power state reported on a state topic
+
+    // entity handles
+    QHash<QString, EntityInterface*> m_externalEntities;  // state targets not created by this integration
+    QVector<ActivityHandle>          m_activities;
+    bool                             m_currentActivityChanged;
+
+    void                           readBridges(const QVariantList& bridges);
+    int                            addConnection(const QString& ip);
+    QStringList                    bridgeLayout() const;
+    bool                           hasEntities(int bridge) const;
+    QString                        entityId(int bridge, const QString& kind, const QString& name) const;
+    CompileJob                     compileJob(int bridge) const;
+    void                           currentActivityReceived(int bridge, const QByteArray& message);
+    void                           configReceived(const QByteArray& message, const QMqttTopicName& topic,
+                                                  const QString& rootKey, int bridge);
+    void                           applyConfig(ConfigCompilation* compilation);
+    bool publishButton(const EntityButtons& entity, const Button& button, const QVariant& value);
+    void                           runActivityMacro(const QString& activityId, bool activate);
+    ActivityMacro::Status runMacroStep(int bridge, const QString& activityId, const ActivityMacro::Step& step);
+    bool                           usedByActivity(const QString& activityId, const QString& deviceId) const;
+    void                           announceEntity(const QString& entityId, bool update);
+    void                           announceEntity(const QString& entityId, const QString& name,
+                                                  const QStringList& supportedFeatures,
+                                                  const QStringList& customFeatures, bool update);
+    void                           removeFromCatalog(const QString& entityId);
+    bool                           materializeEntity(const QString& entityId);
+    void                           materializeConfiguredEntities();
+    void                           bindStates(const QString& entityId);
+    void                           unbindStates(const QString& entityId);
+    static bool                    boundOn(const QVector<StateBinding>& bindings, int connection);
+    void                           subscribeStates(int connection);
+    void                           unsubscribeStates(int connection);
+    bool                           statesSubscribed() const;
+    quint8                         subscriptionQos() const;
+    void                           stateReceived(int connection, const QByteArray& message, const QString& filter);
+    void                           queueState(const QString& entityId, int attribute, const QVariant& value);
+    void                           applyStates();
+    void                           applyCurrentActivity();
+    EntityInterface*               entityInterface(const QString& entityId);
+    void                           updateActivities();
+    void                           invalidateEntityHandles();
+    static int                     stateAttribute(const QString& name);
+    static QVariant                stateValue(int attribute, const QByteArray& message);
+    static int                     powerState(const QString& type, bool on);
+    void removeStaleEntities(int bridge, const QString& prefix, const QSet<QString>& entityIds);
     void                           initOnce();
-    QString                        buttonNameToSupportedFeatures(const QString buttonName);
-    QString                        supportedFeatureToButtonName(const QString supportedFeature);
-    bool                           supportedFeature(const QString& buttonName, QStringList* supportedFeatures);
-    void createButtons(QVariantMap* buttons, bool updateEntity, QString entityId, QString deviceName,
-                       QStringList* supportedFeatures, QStringList* customFeatures);
+    void                           initConnection(int index);
+    void                           transportConnected(int index, QTcpSocket* socket);
+    void                           connected(int index);
+    void                           disconnected(int index);
+    qint32 publish(Connection* connection, const QMqttTopicName& topic, const QByteArray& payload, quint8 qos = 0,
+                   bool retain = false);
+    void                           acknowledged(Connection* connection, qint32 id);
+    void                           checkDeliveries(Connection* connection);
+    void                           requeueDeliveries(Connection* connection);
+    quint16                        topicAlias(Connection* connection, const QMqttTopicName& topic);
+    void                           scheduleReconnect(Connection* connection);
+    void                           publishStats();
+    void                           reconnectNow(Connection* connection);
+    void                           loadSnapshot();
+    void                           addConfigRequest(int bridge, const QString& replyTopic, const QByteArray& payload);
+    void                           sendPendingConfigRequests();
+    void                           sendConfigRequests(int index);
+    void                           sendConfigRequest(int connection, const QString& replyTopic);
+    void                           configReplyReceived(int connection, const QString& replyTopic);
+    void                           saveSnapshot();
 };
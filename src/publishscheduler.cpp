@@ -0,0 +1,157 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "publishscheduler.h"
+
+#include <QSet>
+
+PublishScheduler::PublishScheduler(const Publisher &publisher, const CongestionCheck &congested, QObject *parent)
+    : QObject(parent),
+      m_publisher(publisher),
+      m_congested(congested),
+      m_timer(new QTimer(this)),
+      m_online(false),
+      m_dropped(0),
+      m_expired(0) {
+    m_clock.start();
+    m_timer->setSingleShot(true);
+    QObject::connect(m_timer, &QTimer::timeout, this, &PublishScheduler::flush);
+}
+
+bool PublishScheduler::publish(const QMqttTopicName &topic, const QByteArray &payload, int minInterval, bool coalesce,
+                               int ttl, quint8 qos, bool retain) {
+    bool topicQueued = false;
+    for (Pending &pending : m_queue) {
+        if (pending.topic == topic) {
+            if (coalesce && minInterval > 0 && pending.coalesce) {
+                // last value wins, with the deadline and delivery options of the latest press
+                pending.payload = QByteArray(payload.constData(), payload.size());
+                pending.expires = ttl > 0 ? m_clock.elapsed() + ttl : -1;
+                pending.qos = qos;
+                pending.retain = retain;
+                return true;
+            }
+            topicQueued = true;
+        }
+    }
+
+    // fast path: nothing in the way, send right away
+    if (m_online && !topicQueued && dueIn(topic.name(), minInterval) == 0 && !m_congested()) {
+        send(topic, payload, qos, retain);
+        return true;
+    }
+
+    bool dropped = false;
+    if (m_queue.size() >= QUEUE_LIMIT) {
+        m_queue.removeFirst();
+        m_dropped++;
+        dropped = true;
+    }
+    // the payload may be a raw view into storage that changes before the queue is flushed
+    m_queue.append({topic, QByteArray(payload.constData(), payload.size()), minInterval, coalesce,
+                    ttl > 0 ? m_clock.elapsed() + ttl : -1, qos, retain});
+    int due = static_cast<int>(dueIn(topic.name(), minInterval));
+    if (m_online && (!m_timer->isActive() || m_timer->remainingTime() > due)) {
+        m_timer->start(due);
+    }
+    return !dropped;
+}
+
+void PublishScheduler::setOnline(bool online) {
+    m_online = online;
+    if (!online) {
+        m_timer->stop();
+    } else if (!m_queue.isEmpty()) {
+        // replay what was queued while offline
+        m_timer->start(0);
+    }
+}
+
+void PublishScheduler::clear() {
+    m_timer->stop();
+    m_queue.clear();
+}
+
+qint64 PublishScheduler::dueIn(const QString &topic, int minInterval) const {
+    if (minInterval <= 0) {
+        return 0;
+    }
+    auto lastSent = m_lastSent.constFind(topic);
+    if (lastSent == m_lastSent.constEnd()) {
+        return 0;
+    }
+    return qMax(Q_INT64_C(0), *lastSent + minInterval - m_clock.elapsed());
+}
+
+void PublishScheduler::send(const QMqttTopicName &topic, const QByteArray &payload, quint8 qos, bool retain) {
+    m_publisher(topic, payload, qos, retain);
+    m_lastSent.insert(topic.name(), m_clock.elapsed());
+}
+
+void PublishScheduler::flush() {
+    if (!m_online) {
+        return;
+    }
+
+    // presses that waited too long are dropped, sending them late would surprise the user
+    qint64 now = m_clock.elapsed();
+    for (auto pending = m_queue.begin(); pending != m_queue.end();) {
+        if (pending->expires >= 0 && pending->expires < now) {
+            pending = m_queue.erase(pending);
+            m_expired++;
+        } else {
+            ++pending;
+        }
+    }
+
+    // write everything that is due in one pass, keeping the order per topic
+    qint64        next = -1;
+    QSet<QString> blocked;
+    for (auto pending = m_queue.begin(); pending != m_queue.end();) {
+        if (m_congested()) {
+            next = CONGESTION_RETRY;
+            break;
+        }
+        if (blocked.contains(pending->topic.name())) {
+            ++pending;
+            continue;
+        }
+        qint64 due = dueIn(pending->topic.name(), pending->minInterval);
+        if (due > 0) {
+            blocked.insert(pending->topic.name());
+            next = next < 0 ? due : qMin(next, due);
+            ++pending;
+            continue;
+        }
+        send(pending->topic, pending->payload, pending->qos, pending->retain);
+        // a second publish on the same topic has to wait for the next interval
+        if (pending->minInterval > 0) {
+            blocked.insert(pending->topic.name());
+            next = next < 0 ? pending->minInterval : qMin(next, static_cast<qint64>(pending->minInterval));
+        }
+        pending = m_queue.erase(pending);
+    }
+    if (!m_queue.isEmpty()) {
+        m_timer->start(static_cast<int>(qMax(Q_INT64_C(0), next)));
+    }
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QtMqtt/qmqtttopicname.h>
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QTimer>
+#include <functional>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// PUBLISH SCHEDULER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Outbound publish scheduler for button commands.
+// A publish goes out immediately unless its topic is rate limited or the connection is congested. Otherwise it is
+// queued and all queued publishes that are due are written in one pass, which the socket sends as one flush.
+// Rate limited topics can coalesce queued publishes so only the latest value is sent (for idempotent commands).
+// The queue is bounded: when it is full the oldest publish is dropped.
+// While offline everything is queued and replayed in order when going online, except publishes older than their TTL.
+class PublishScheduler : public QObject {
+    Q_OBJECT
+
+ public:
+    typedef std::function<qint32(const QMqttTopicName& topic, const QByteArray& payload, quint8 qos, bool retain)>
+        Publisher;
+    typedef std::function<bool()> CongestionCheck;
+
+    static const int QUEUE_LIMIT = 64;
+    static const int CONGESTION_RETRY = 10;  // ms
+
+    PublishScheduler(const Publisher& publisher, const CongestionCheck& congested, QObject* parent = nullptr);
+
+    // minInterval: minimum time between two publishes on the topic in ms, 0 for no limit
+    // ttl: time in ms a queued publish stays valid, 0 for no limit
+    // the payload is copied when queued, so it may be a raw view (QByteArray::fromRawData)
+    // returns false if a queued publish had to be dropped
+    bool publish(const QMqttTopicName& topic, const QByteArray& payload, int minInterval = 0, bool coalesce = true,
+                 int ttl = 0, quint8 qos = 0, bool retain = false);
+
+    void setOnline(bool online);
+    bool isOnline() const { return m_online; }
+    void clear();
+    int  queued() const { return m_queue.size(); }
+    int  dropped() const { return m_dropped; }
+    int  expired() const { return m_expired; }
+
+ private:
+    struct Pending {
+        QMqttTopicName topic;
+        QByteArray     payload;
+        int            minInterval;
+        bool           coalesce;
+        qint64         expires;  // -1: never
+        quint8         qos;
+        bool           retain;
+    };
+
+    Publisher              m_publisher;
+    CongestionCheck        m_congested;
+    QList<Pending>         m_queue;
+    QHash<QString, qint64> m_lastSent;  // topic -> time of the last publish
+    QElapsedTimer          m_clock;
+    QTimer*                m_timer;
+    bool                   m_online;
+    int                    m_dropped;
+    int                    m_expired;
+
+    qint64 dueIn(const QString& topic, int minInterval) const;
+    void   send(const QMqttTopicName& topic, const QByteArray& payload, quint8 qos, bool retain);
+    void   flush();
+};
@@ -0,0 +1,126 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#include "topicrouter.h"
+
+#include <QStringList>
+
+TopicRouter::TopicRouter() : m_root(new Node()) {}
+
+TopicRouter::~TopicRouter() { delete m_root; }
+
+void TopicRouter::addRoute(const QString &filter, const Handler &handler) {
+    find(filter, true)->handlers.append(handler);
+}
+
+void TopicRouter::removeRoutes(const QString &filter) {
+    Node *node = find(filter, false);
+    if (node != nullptr) {
+        node->handlers.clear();
+    }
+}
+
+void TopicRouter::clear() {
+    delete m_root;
+    m_root = new Node();
+}
+
+int TopicRouter::route(const QByteArray &message, const QMqttTopicName &topic) const {
+    Matches matches;
+    match(m_root, topic.name(), 0, &matches);
+    for (const Handler *handler : matches) {
+        (*handler)(message, topic);
+    }
+    return matches.size();
+}
+
+TopicRouter::Node *TopicRouter::find(const QString &filter, bool create) {
+    Node *node = m_root;
+    for (const QString &level : filter.split('/')) {
+        Node::Kind kind = level == "+" ? Node::SingleLevelWildcard
+                                       : (level == "#" ? Node::MultiLevelWildcard : Node::Level);
+        Node *child = nullptr;
+        for (Node *existing : node->children) {
+            if (existing->kind == kind && existing->level == level) {
+                child = existing;
+                break;
+            }
+        }
+        if (child == nullptr) {
+            if (!create) {
+                return nullptr;
+            }
+            child = new Node();
+            child->kind = kind;
+            child->level = level;
+            node->children.append(child);
+        }
+        node = child;
+    }
+    return node;
+}
+
+void TopicRouter::match(const Node *node, const QString &topic, int from, Matches *matches) const {
+    if (from < 0) {
+        // all levels consumed: "a/#" also matches "a"
+        for (const Handler &handler : node->handlers) {
+            matches->append(&handler);
+        }
+        for (const Node *child : node->children) {
+            if (child->kind == Node::MultiLevelWildcard) {
+                for (const Handler &handler : child->handlers) {
+                    matches->append(&handler);
+                }
+            }
+        }
+        return;
+    }
+
+    int        end = topic.indexOf('/', from);
+    QStringRef level = topic.midRef(from, end < 0 ? -1 : end - from);
+    int        next = end < 0 ? -1 : end + 1;
+    // wildcards at the first level don't match topics starting with $
+    bool wildcards = from > 0 || !topic.startsWith('$');
+
+    for (const Node *child : node->children) {
+        switch (child->kind) {
+            case Node::Level:
+                if (child->level == level) {
+                    match(child, topic, next, matches);
+                }
+                break;
+            case Node::SingleLevelWildcard:
+                if (wildcards) {
+                    match(child, topic, next, matches);
+                }
+                break;
+            case Node::MultiLevelWildcard:
+                if (wildcards) {
+                    for (const Handler &handler : child->handlers) {
+                        matches->append(&handler);
+                    }
+                }
+                break;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/******************************************************************************
+ *
+ * Copyright (C) 2020 Nikolas Slottke <nikoslottke@gmail.com>
+ *
+ * This file is part of the YIO-Remote software project.
+ *
+ * YIO-Remote software is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * YIO-Remote software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with YIO-Remote software. If not, see <https://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ *****************************************************************************/
+
+
+#pragma once
+
+#include <QtMqtt/qmqtttopicname.h>
+
+#include <QByteArray>
+#include <QString>
+#include <QVarLengthArray>
+#include <QVector>
+#include <functional>
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//// TOPIC ROUTER
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// Dispatches received messages to handlers registered for MQTT topic filters (including + and # wildcards).
+// Filters are kept in a trie keyed on topic levels, so a message is matched in one walk over its topic levels before
+// any payload is looked at, independent of the number of registered handlers.
+class TopicRouter {
+ public:
+    typedef std::function<void(const QByteArray& message, const QMqttTopicName& topic)> Handler;
+
+    TopicRouter();
+    ~TopicRouter();
+
+    void addRoute(const QString& filter, const Handler& handler);
+    void removeRoutes(const QString& filter);
+    void clear();
+
+    // calls all handlers with a filter matching the topic, returns the number of handlers called.
+    // Handlers must not change the routes.
+    int route(const QByteArray& message, const QMqttTopicName& topic) const;
+
+ private:
+    Q_DISABLE_COPY(TopicRouter)
+
+    struct Node {
+        enum Kind { Level, SingleLevelWildcard, MultiLevelWildcard };
+        ~Node() { qDeleteAll(children); }
+        Kind             kind = Level;
+        QString          level;
+        QVector<Node*>   children;
+        QVector<Handler> handlers;
+    };
+    typedef QVarLengthArray<const Handler*, 8> Matches;
+
+    Node* m_root;
+
+    Node* find(const QString& filter, bool create);
+    void  match(const Node* node, const QString& topic, int from, Matches* matches) const;
+};